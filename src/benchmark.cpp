@@ -0,0 +1,350 @@
+#include "benchmark.hpp"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "huffman_coding.hpp"
+#include "kernels.hpp"
+#include "table_cache.hpp"
+#include "test_file.hpp"
+#include "utils/affinity.hpp"
+#include "utils/allocations.hpp"
+#include "utils/bench.hpp"
+#include "utils/byte_stream.hpp"
+#include "utils/json.hpp"
+
+namespace {
+
+struct Trials {
+    Samples seconds;
+    std::size_t allocations = 0;  // most made by one trial, once counted
+    std::array<Samples, HuffmanCoding::stages> stages;
+    // summed over trials, per thread
+    std::array<std::vector<Counters::Values>, HuffmanCoding::stages> counts;
+
+    void add(double elapsed, std::size_t trial_allocations,
+             const HuffmanCoding::Profile &profile) {
+        seconds.add(elapsed);
+        allocations = std::max(allocations, trial_allocations);
+        for (std::size_t i = 0; i < HuffmanCoding::stages; ++i) {
+            HuffmanCoding::Stage stage = static_cast<HuffmanCoding::Stage>(i);
+            stages[i].add(profile[stage]);
+            const std::vector<Counters::Values> &stage_counts =
+                profile.counts(stage);
+            counts[i].resize(stage_counts.size(), Counters::Values{0});
+            for (std::size_t j = 0; j < stage_counts.size(); ++j) {
+                for (std::size_t k = 0; k < Counters::events; ++k) {
+                    counts[i][j][k] += stage_counts[j][k];
+                }
+            }
+        }
+    }
+};
+
+void write_samples(Json &json, const Samples &samples) {
+    json.key("p50")
+        .value(samples.percentile(50))
+        .key("p99")
+        .value(samples.percentile(99))
+        .key("min")
+        .value(samples.min())
+        .key("mean")
+        .value(samples.mean());
+}
+
+void write_values(Json &json, const Counters::Values &values, double scale) {
+    json.begin_object();
+    for (std::size_t i = 0; i < Counters::events; ++i) {
+        json.key(Counters::names[i]).value(values[i] * scale);
+    }
+    json.end_object();
+}
+
+// mean per trial, aggregated and per thread
+void write_counts(Json &json, const std::vector<Counters::Values> &counts,
+                  std::size_t trials) {
+    double scale = 1.0 / trials;
+    Counters::Values aggregate = {0};
+    for (const Counters::Values &values : counts) {
+        for (std::size_t i = 0; i < Counters::events; ++i) {
+            aggregate[i] += values[i];
+        }
+    }
+    json.begin_object().key("aggregate");
+    write_values(json, aggregate, scale);
+    json.key("threads").begin_array();
+    for (const Counters::Values &values : counts) {
+        write_values(json, values, scale);
+    }
+    json.end_array().end_object();
+}
+
+void write_trials(Json &json, const Trials &trials, std::size_t size) {
+    double mb = size / 1e6;
+    json.begin_object();
+    json.key("mb_s")
+        .begin_object()
+        .key("p50")
+        .value(mb / trials.seconds.percentile(50))
+        .key("p99")
+        .value(mb / trials.seconds.percentile(99))
+        .end_object();
+    json.key("seconds").begin_object();
+    write_samples(json, trials.seconds);
+    json.end_object();
+    json.key("allocations");
+    if (allocations()) {
+        json.value(trials.allocations);
+    } else {
+        json.null();
+    }
+    json.key("stages").begin_object();
+    for (std::size_t i = 0; i < HuffmanCoding::stages; ++i) {
+        if (trials.stages[i].max() == 0) {
+            continue;  // stage belongs to the other direction
+        }
+        json.key(HuffmanCoding::stage_names[i]).begin_object();
+        write_samples(json, trials.stages[i]);
+        if (!trials.counts[i].empty()) {
+            json.key("counters");
+            write_counts(json, trials.counts[i], trials.seconds.size());
+        }
+        json.end_object();
+    }
+    json.end_object();
+    json.end_object();
+}
+
+bool same_contents(const std::string &lhs, const std::string &rhs) {
+    IByteStream lhs_ibs(lhs);
+    IByteStream rhs_ibs(rhs);
+    return lhs_ibs.size() == rhs_ibs.size() &&
+           std::memcmp(lhs_ibs.map(), rhs_ibs.map(), lhs_ibs.size()) == 0;
+}
+
+}  // namespace
+
+std::string Benchmark::run(const Options &options,
+                           std::size_t &max_allocations) {
+    max_allocations = 0;
+    std::filesystem::path directory =
+        options.directory.empty()
+            ? std::filesystem::temp_directory_path()
+            : std::filesystem::path(options.directory);
+
+    std::vector<std::pair<std::string, std::string>> inputs;  // name, path
+    std::vector<std::string> generated;
+    if (options.pathnames.empty()) {
+        std::vector<TestFile::Corpus> corpora = options.corpora;
+        if (corpora.empty()) {
+            for (std::size_t i = 0; i < TestFile::corpora; ++i) {
+                corpora.push_back(static_cast<TestFile::Corpus>(i));
+            }
+        }
+        for (TestFile::Corpus corpus : corpora) {
+            std::string name(
+                TestFile::corpus_names[static_cast<std::size_t>(corpus)]);
+            std::string pathname = directory / ("sloth-bench-" + name);
+            TestFile::generate(pathname, options.size, corpus, options.seed);
+            inputs.emplace_back(name, pathname);
+            generated.push_back(pathname);
+        }
+    } else {
+        for (const std::string &pathname : options.pathnames) {
+            inputs.emplace_back(pathname, pathname);
+        }
+    }
+    std::string encoded_pathname = directory / "sloth-bench.sloth";
+    std::string decoded_pathname = directory / "sloth-bench";
+
+    Json json;
+    json.begin_object()
+        .key("trials")
+        .value(options.trials)
+        .key("seed")
+        .value(options.seed)
+        .key("max_threads")
+        .value(omp_get_max_threads())
+        .key("numa_nodes")
+        .value(Topology::get().nodes())
+        .key("detected_kernel")
+        .value(HuffmanCoding::kernel_names[static_cast<std::size_t>(
+            HuffmanCoding::kernel())])
+        .key("results")
+        .begin_array();
+    HuffmanCoding::Kernel detected = HuffmanCoding::kernel();
+    std::vector<HuffmanCoding::Kernel> kernels = options.kernels;
+    if (kernels.empty()) {
+        kernels.push_back(detected);
+    }
+    std::vector<HuffmanCoding::Layout> layouts = options.layouts;
+    if (layouts.empty()) {
+        for (std::size_t i = 0; i < HuffmanCoding::layouts; ++i) {
+            layouts.push_back(static_cast<HuffmanCoding::Layout>(i));
+        }
+    }
+    std::vector<int> levels = options.levels;
+    if (levels.empty()) {
+        for (int level = HuffmanCoding::min_level;
+             level <= HuffmanCoding::max_level; ++level) {
+            levels.push_back(level);
+        }
+    }
+    for (const auto &[name, pathname] : inputs) {
+        std::size_t size = std::filesystem::file_size(pathname);
+
+        // kernel, layout, level, parallel, threads, placed
+        std::vector<std::tuple<HuffmanCoding::Kernel, HuffmanCoding::Layout,
+                               int, bool, int, bool>>
+            configs;
+        for (HuffmanCoding::Kernel kernel : kernels) {
+            for (HuffmanCoding::Layout layout : layouts) {
+                for (int level : levels) {
+                    configs.emplace_back(kernel, layout, level, false, 1,
+                                         false);
+                    for (int threads : options.threads) {
+                        configs.emplace_back(kernel, layout, level, true,
+                                             threads, false);
+                        if (options.placement) {
+                            configs.emplace_back(kernel, layout, level, true,
+                                                 threads, true);
+                        }
+                    }
+                }
+            }
+        }
+        for (const auto &[kernel, layout, level, parallel, threads, placed] :
+             configs) {
+            HuffmanCoding::set_kernel(kernel);
+            std::optional<Counters> counters;
+            if (options.counters) {
+                counters.emplace();
+            }
+            Counters *counters_ptr = counters ? &*counters : nullptr;
+            // shared by every trial, as a long-running embedding would
+            HuffmanCoding::Context context;
+            context.options_.threads = threads;
+            context.options_.pin = placed;
+            context.options_.numa_local = placed;
+            context.options_.layout = layout;
+            context.options_.level = level;
+            auto encode = [&](HuffmanCoding::Profile *profile) {
+                return parallel ? HuffmanCoding::Parallel::Processor::encode(
+                                      context, pathname, encoded_pathname,
+                                      profile)
+                                : HuffmanCoding::Serial::Processor::encode(
+                                      context, pathname, encoded_pathname,
+                                      profile);
+            };
+            auto decode = [&](HuffmanCoding::Profile *profile) {
+                if (parallel) {
+                    HuffmanCoding::Parallel::Processor::decode(
+                        context, encoded_pathname, decoded_pathname, profile);
+                } else {
+                    HuffmanCoding::Serial::Processor::decode(
+                        context, encoded_pathname, decoded_pathname, profile);
+                }
+            };
+
+            // warm-up, also fills the page cache and grows the context
+            std::size_t encoded_size = encode(nullptr);
+            decode(nullptr);
+            bool roundtrip =
+                same_contents(pathname, decoded_pathname + ".res");
+
+            Trials encode_trials;
+            Trials decode_trials;
+            HuffmanCoding::TableCache &cache =
+                HuffmanCoding::TableCache::get();
+            HuffmanCoding::TableCache::Stats cache_before = cache.stats();
+            for (std::size_t trial = 0; trial < options.trials; ++trial) {
+                {
+                    HuffmanCoding::Profile profile(counters_ptr);
+                    std::size_t before = allocations().value_or(0);
+                    Bench bench;
+                    encode(&profile);
+                    double elapsed = bench.elapsed();
+                    encode_trials.add(elapsed,
+                                      allocations().value_or(0) - before,
+                                      profile);
+                }
+                {
+                    HuffmanCoding::Profile profile(counters_ptr);
+                    std::size_t before = allocations().value_or(0);
+                    Bench bench;
+                    decode(&profile);
+                    double elapsed = bench.elapsed();
+                    decode_trials.add(elapsed,
+                                      allocations().value_or(0) - before,
+                                      profile);
+                }
+            }
+            HuffmanCoding::TableCache::Stats cache_stats =
+                cache.stats() - cache_before;
+            max_allocations = std::max({max_allocations,
+                                        encode_trials.allocations,
+                                        decode_trials.allocations});
+
+            json.begin_object()
+                .key("input")
+                .value(name)
+                .key("mode")
+                .value(parallel ? "parallel" : "serial")
+                .key("threads")
+                .value(threads)
+                .key("placement")
+                .value(placed)
+                .key("kernel")
+                .value(HuffmanCoding::kernel_names[static_cast<std::size_t>(
+                    kernel)])
+                .key("layout")
+                .value(HuffmanCoding::layout_names[static_cast<std::size_t>(
+                    layout)])
+                .key("level")
+                .value(level)
+                .key("size")
+                .value(size)
+                .key("encoded_size")
+                .value(encoded_size)
+                .key("ratio")
+                .value(size / static_cast<double>(encoded_size))
+                .key("roundtrip")
+                .value(roundtrip)
+                .key("counters_available")
+                .value(counters.has_value() && counters->available());
+            json.key("table_cache")
+                .begin_object()
+                .key("hits")
+                .value(cache_stats.hits)
+                .key("misses")
+                .value(cache_stats.misses)
+                .key("evictions")
+                .value(cache_stats.evictions)
+                .key("hit_rate")
+                .value(cache_stats.hit_rate())
+                .end_object();
+            json.key("encode");
+            write_trials(json, encode_trials, size);
+            json.key("decode");
+            write_trials(json, decode_trials, size);
+            json.end_object();
+        }
+    }
+    json.end_array().end_object();
+    HuffmanCoding::set_kernel(detected);
+
+    std::filesystem::remove(encoded_pathname);
+    std::filesystem::remove(decoded_pathname + ".res");
+    for (const std::string &pathname : generated) {
+        std::filesystem::remove(pathname);
+    }
+    return json.str();
+}
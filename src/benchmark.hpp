@@ -0,0 +1,37 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "kernels.hpp"
+#include "test_file.hpp"
+
+class Benchmark {
+   public:
+    struct Options {
+        std::vector<std::string> pathnames;  // generated when empty
+        std::vector<TestFile::Corpus> corpora;  // all when empty
+        std::vector<int> threads;               // parallel thread counts
+        std::size_t trials = 5;
+        std::size_t size = 64e6;  // bytes per generated input
+        uint64_t seed = TestFile::default_seed;
+        std::string directory;  // scratch space for generated files
+        bool counters = false;  // collect perf_event counters per stage
+        std::vector<HuffmanCoding::Kernel> kernels;  // the detected when empty
+        std::vector<HuffmanCoding::Layout> layouts;  // all when empty
+        std::vector<int> levels;                     // all when empty
+        // also run every parallel config pinned, with NUMA-local blocks
+        bool placement = false;
+    };
+
+    // runs every input through serial and parallel encode/decode, returns a
+    // JSON report. max_allocations is the most heap allocations any trial
+    // made after warm-up, 0 unless allocations() counts them
+    static std::string run(const Options &options,
+                           std::size_t &max_allocations);
+};
+
+#endif
@@ -0,0 +1,268 @@
+#include "format.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+
+namespace HuffmanCoding {
+
+namespace {
+
+/*
+ * Code length alphabet, after DEFLATE (RFC 1951, 3.2.7), as 5-bit tokens
+ * followed by their extra bits
+ *   0-16: literal length
+ *   17: repeat the previous length 3-6 times (2 extra bits)
+ *   18: repeat a zero length 3-10 times (3 extra bits)
+ *   19: repeat a zero length 11-138 times (7 extra bits)
+ */
+constexpr std::size_t token_bits = 5;
+constexpr uint8_t repeat_previous = 17;
+constexpr uint8_t repeat_zero_short = 18;
+constexpr uint8_t repeat_zero_long = 19;
+
+class BitWriter {
+    std::vector<uint8_t> &out_;
+    std::size_t bits_ = 0;
+
+   public:
+    BitWriter(std::vector<uint8_t> &out) : out_(out) {}
+
+    void write(uint32_t value, std::size_t size) {
+        for (std::size_t i = size; i-- > 0;) {
+            if (bits_ % 8 == 0) {
+                out_.push_back(0);
+            }
+            out_.back() |= ((value >> i) & 1) << (7 - bits_ % 8);
+            ++bits_;
+        }
+    }
+};
+
+class BitReader {
+    const uint8_t *in_;
+    std::size_t size_;
+    std::size_t bits_ = 0;
+
+   public:
+    BitReader(const uint8_t *in, std::size_t size) : in_(in), size_(size) {}
+
+    // false once a read runs past the end
+    bool read(std::size_t size, uint32_t &value) {
+        if (bits_ + size > size_ * 8) {
+            return false;
+        }
+        value = 0;
+        for (std::size_t i = 0; i < size; ++i, ++bits_) {
+            value = (value << 1) | ((in_[bits_ / 8] >> (7 - bits_ % 8)) & 1);
+        }
+        return true;
+    }
+
+    std::size_t bytes() const { return (bits_ + 7) / 8; }
+};
+
+void write_varint(std::vector<uint8_t> &out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+bool read_varint(const uint8_t *&p, const uint8_t *end, uint64_t &value) {
+    value = 0;
+    for (std::size_t shift = 0; shift < 64; shift += 7) {
+        if (p == end) {
+            return false;
+        }
+        uint8_t byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void write_code_lengths(std::vector<uint8_t> &out,
+                        const std::array<uint8_t, 256> &code_lengths) {
+    BitWriter writer(out);
+    int previous = -1;
+    for (std::size_t i = 0; i < 256;) {
+        uint8_t length = code_lengths[i];
+        std::size_t run = 1;
+        while (i + run < 256 && code_lengths[i + run] == length) {
+            ++run;
+        }
+        if (length == 0 && run >= 11) {
+            run = std::min<std::size_t>(run, 138);
+            writer.write(repeat_zero_long, token_bits);
+            writer.write(run - 11, 7);
+        } else if (length == 0 && run >= 3) {
+            writer.write(repeat_zero_short, token_bits);
+            writer.write(run - 3, 3);
+        } else if (length == previous && run >= 3) {
+            run = std::min<std::size_t>(run, 6);
+            writer.write(repeat_previous, token_bits);
+            writer.write(run - 3, 2);
+        } else {
+            run = 1;
+            writer.write(length, token_bits);
+        }
+        previous = length;
+        i += run;
+    }
+}
+
+bool read_code_lengths(const uint8_t *&p, const uint8_t *end,
+                       std::array<uint8_t, 256> &code_lengths) {
+    BitReader reader(p, end - p);
+    for (std::size_t i = 0; i < 256;) {
+        uint32_t token;
+        if (!reader.read(token_bits, token)) {
+            return false;
+        }
+        uint32_t run = 1;
+        uint8_t length = token;
+        if (token == repeat_previous) {
+            if (i == 0 || !reader.read(2, run)) {
+                return false;
+            }
+            run += 3;
+            length = code_lengths[i - 1];
+        } else if (token == repeat_zero_short) {
+            if (!reader.read(3, run)) {
+                return false;
+            }
+            run += 3;
+            length = 0;
+        } else if (token == repeat_zero_long) {
+            if (!reader.read(7, run)) {
+                return false;
+            }
+            run += 11;
+            length = 0;
+        } else if (token > max_code_length) {
+            return false;
+        }
+        if (i + run > 256) {
+            return false;
+        }
+        std::fill_n(code_lengths.begin() + i, run, length);
+        i += run;
+    }
+    p += reader.bytes();
+    return true;
+}
+
+std::string parse_v1(const uint8_t *&p, const uint8_t *end, Header &header) {
+    uint64_t value;
+    if (!read_varint(p, end, value)) {
+        return "truncated header";
+    }
+    header.decoded_size = value;
+    if (!read_varint(p, end, value)) {
+        return "truncated header";
+    }
+    header.block_size = value;
+    if (header.block_size == 0 || header.block_size > max_block_size) {
+        return "invalid block size";
+    }
+    if (!read_code_lengths(p, end, header.code_lengths)) {
+        return "invalid code lengths";
+    }
+
+    std::size_t blocks = header.decoded_size / header.block_size +
+                         (header.decoded_size % header.block_size != 0);
+    if (blocks > static_cast<std::size_t>(end - p) / 9) {
+        return "truncated block index";  // each entry is at least 9 bytes
+    }
+    header.offsets.assign(blocks + 1, 0);
+    header.checksums.assign(blocks, 0);
+    for (std::size_t i = 0; i < blocks; ++i) {
+        if (!read_varint(p, end, value) || end - p < 8) {
+            return "truncated block index";
+        }
+        header.offsets[i + 1] = header.offsets[i] + value;
+        // every byte decodes from at least a bit, so the body that follows
+        // bounds the decoded size
+        std::size_t decoded =
+            header.decoded_end(i) - header.decoded_begin(i);
+        if (header.offsets[i + 1] < header.offsets[i] ||
+            value < decoded / 8 + (decoded % 8 != 0)) {
+            return std::format("block {} has an invalid size", i);
+        }
+        std::memcpy(&header.checksums[i], p, 8);
+        p += 8;
+    }
+    return "";
+}
+
+}  // namespace
+
+std::size_t Header::blocks() const { return checksums.size(); }
+
+std::size_t Header::begin(std::size_t block) const { return offsets[block]; }
+
+std::size_t Header::end(std::size_t block) const { return offsets[block + 1]; }
+
+std::size_t Header::decoded_begin(std::size_t block) const {
+    return block * block_size;
+}
+
+std::size_t Header::decoded_end(std::size_t block) const {
+    return std::min(decoded_begin(block) + block_size, decoded_size);
+}
+
+std::size_t Header::member_size() const { return size + offsets.back(); }
+
+void Header::serialize(std::vector<uint8_t> &out) const {
+    out.assign(magic.begin(), magic.end());
+    out.push_back(version);
+    out.push_back(flags);
+    write_varint(out, decoded_size);
+    write_varint(out, block_size);
+    write_code_lengths(out, code_lengths);
+    for (std::size_t i = 0; i < blocks(); ++i) {
+        write_varint(out, end(i) - begin(i));
+        out.resize(out.size() + 8);
+        std::memcpy(out.data() + out.size() - 8, &checksums[i], 8);
+    }
+}
+
+std::string Header::parse(const uint8_t *map, std::size_t size,
+                          Header &header) {
+    if (size < magic.size() + 2 ||
+        !std::equal(magic.begin(), magic.end(), map)) {
+        return "not a sloth file";
+    }
+    header.version = map[4];
+    header.flags = map[5];
+    const uint8_t *p = map + magic.size() + 2;
+    const uint8_t *end = map + size;
+
+    std::string error;
+    switch (header.version) {
+        case 1: {
+            if ((header.flags & ~known_flags) != 0) {
+                return std::format("unsupported flags {:#x}", header.flags);
+            }
+            error = parse_v1(p, end, header);
+            break;
+        }
+        default: {
+            return std::format("unsupported version {}", header.version);
+        }
+    }
+    if (!error.empty()) {
+        return error;
+    }
+    header.size = p - map;
+    if (header.offsets.back() > static_cast<std::size_t>(end - p)) {
+        return "body is shorter than the block index";
+    }
+    return "";
+}
+
+}  // namespace HuffmanCoding
@@ -0,0 +1,69 @@
+#ifndef FORMAT_HPP
+#define FORMAT_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace HuffmanCoding {
+
+/*
+ * A file is one or more members, each a header and the body it indexes,
+ * decoding to the concatenation of theirs. Appending to a file adds a
+ * member, so the ones before are never rewritten.
+ *
+ * Member header:
+ * 0-3: magic
+ * 4: version
+ * 5: flags
+ *   bit 0: the body is packed LSB-first, codes bit-reversed, and every
+ *          block ends with 8 zero bytes of padding
+ * then, for version 1:
+ *   varint decoded size
+ *   varint block size
+ *   run-length coded code lengths
+ *   per block, varint encoded size and 8-byte checksum of its decoded bytes
+ */
+constexpr std::array<uint8_t, 4> magic = {'S', 'L', 'T', 'H'};
+constexpr uint8_t version = 1;
+constexpr std::size_t max_block_size = 1 << 30;
+constexpr std::size_t max_code_length = 16;
+constexpr uint8_t lsb_first_flag = 1;
+constexpr uint8_t known_flags = lsb_first_flag;
+
+/**
+ * Everything of a member before its encoded body
+ */
+struct Header {
+    uint8_t version = HuffmanCoding::version;
+    uint8_t flags = 0;
+    std::size_t decoded_size = 0;
+    std::size_t block_size = 0;
+    std::array<uint8_t, 256> code_lengths = {0};
+    std::vector<std::size_t> offsets;  // blocks + 1 offsets into the body
+    std::vector<uint64_t> checksums;
+    std::size_t size = 0;  // serialized bytes, set by parse
+
+    // of the header and body
+    std::size_t member_size() const;
+    std::size_t blocks() const;
+    // encoded byte range of a block within the body
+    std::size_t begin(std::size_t block) const;
+    std::size_t end(std::size_t block) const;
+    std::size_t decoded_begin(std::size_t block) const;
+    std::size_t decoded_end(std::size_t block) const;
+
+    // replaces the contents of out, reusing its capacity
+    void serialize(std::vector<uint8_t> &out) const;
+    // the member at map, followed by size - member_size() bytes of the next
+    // ones. Returns the first inconsistency found, empty when the header is
+    // usable
+    static std::string parse(const uint8_t *map, std::size_t size,
+                             Header &header);
+};
+
+}  // namespace HuffmanCoding
+
+#endif
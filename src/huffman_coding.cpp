@@ -1,105 +1,198 @@
 #include "huffman_coding.hpp"
 
+#include <fcntl.h>
+#include <omp.h>
 #include <unistd.h>
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <filesystem>
+#include <format>
 #include <map>
+#include <memory>
+#include <numeric>
 #include <stack>
 #include <vector>
 
+#include "table_cache.hpp"
+#include "utils/affinity.hpp"
+#include "utils/async_io.hpp"
 #include "utils/bench.hpp"
 #include "utils/byte_stream.hpp"
+#include "utils/hash.hpp"
 #include "utils/print.hpp"
-#include "utils/sizes.hpp"
 
 namespace HuffmanCoding {
 /**
  * Symbol
  */
 
-Symbols::PackageMergeItem::PackageMergeItem() : weight_(0) {}
-
-Symbols::PackageMergeItem::PackageMergeItem(Symbol *symbol)
-    : weight_(symbol->weight_) {
-    symbols_.push_back(symbol);
-}
-
-bool Symbols::PackageMergeItem::operator<(const PackageMergeItem &rhs) const {
-    return weight_ < rhs.weight_;
-}
-
-Symbols::PackageMergeItem Symbols::PackageMergeItem::operator+(
-    const PackageMergeItem &rhs) const {
-    PackageMergeItem item;
-    item.symbols_.reserve(symbols_.size() + rhs.symbols_.size());
-    item.symbols_.insert(item.symbols_.end(), symbols_.begin(), symbols_.end());
-    item.symbols_.insert(item.symbols_.end(), rhs.symbols_.begin(),
-                         rhs.symbols_.end());
-    item.weight_ = weight_ + rhs.weight_;
-    return item;
-}
-
-Symbols::Symbols() : symbols_(nullptr), size_(0) {}
-
-Symbols::~Symbols() { delete[] symbols_; }
-
 Symbol &Symbols::operator[](std::size_t index) { return symbols_[index]; }
 
 void Symbols::initialize(std::size_t size) {
-    assert(symbols_ == nullptr);
-    symbols_ = new Symbol[size];
+    assert(size <= symbols_.size());
     size_ = size;
 }
 
-void Symbols::fill_lengths() {
-    if (size_ == 1) {
-        return;
+void Symbols::initialize(const std::array<std::size_t, 256> &counts) {
+    initialize(256 - std::count(counts.begin(), counts.end(), 0));
+    for (std::size_t i = 0, end = 0; i < 256; ++i) {
+        if (counts[i] != 0) {
+            std::size_t j = end++;
+            symbols_[j] = {
+                .weight_ = counts[i],
+                .value_ = static_cast<uint8_t>(i),
+                .length_ = 0,
+            };
+        }
     }
+}
+
+/*
+ * Every level merges the leaves, in order of weight, with the pairs of the
+ * previous level until it holds the 2n - 2 items to select. Going back down,
+ * the selected packages of a level select a prefix twice their number of the
+ * level below, and every selected leaf adds a bit to its symbol. With
+ * max_length levels, no symbol gets more bits than that.
+ */
+void Symbols::fill_lengths(std::size_t max_length) {
+    if (size_ <= 1) {
+        if (size_ == 1) {
+            symbols_[0].length_ = 1;
+        }
+        return;  // an empty input has no symbols
+    }
+    std::sort(symbols_.begin(), symbols_.begin() + size_,
+              [](const Symbol &lhs, const Symbol &rhs) {
+                  return lhs.weight_ < rhs.weight_;
+              });
     std::size_t cutoff = 2 * size_ - 2;
-    std::vector<PackageMergeItem> items;
-    items.reserve(size_);
+    items_.clear();
     for (std::size_t i = 0; i < size_; ++i) {
-        items.emplace_back(&symbols_[i]);
+        items_.push_back({symbols_[i].weight_, static_cast<int16_t>(i)});
+    }
+    std::array<std::size_t, 64> begins = {0};
+    std::size_t levels = 1;
+    assert(std::size_t{1} << max_length >= size_);
+    while (levels < max_length) {
+        assert(levels < begins.size());
+        std::size_t previous = begins[levels - 1];
+        std::size_t packages = (items_.size() - previous) / 2;
+        begins[levels++] = items_.size();
+        for (std::size_t i = 0, j = 0; i < size_ || j < packages;) {
+            uint64_t weight = 0;
+            if (j < packages) {
+                weight = items_[previous + 2 * j].weight_ +
+                         items_[previous + 2 * j + 1].weight_;
+            }
+            if (j == packages || (i < size_ && items_[i].weight_ <= weight)) {
+                items_.push_back(items_[i++]);
+            } else {
+                items_.push_back({weight, -1});
+                ++j;
+            }
+        }
     }
-    while (items.size() < cutoff) {
-        std::sort(items.begin(), items.end());
-        std::vector<PackageMergeItem> packaged_items;
-        packaged_items.reserve(items.size() / 2);
-        std::size_t i;
-        for (i = 0; i < items.size() - 2; i += 2) {
-            packaged_items.push_back(std::move(items[i] + items[i + 1]));
+    for (std::size_t level = levels, selected = cutoff; level-- > 0;) {
+        std::size_t packages = 0;
+        for (std::size_t i = begins[level]; i < begins[level] + selected; ++i) {
+            if (items_[i].symbol_ < 0) {
+                ++packages;
+            } else {
+                ++symbols_[items_[i].symbol_].length_;
+            }
         }
-        if ((items.size() & 1) == 0) {
-            packaged_items.push_back(std::move(items[i] + items[i + 1]));
+        selected = 2 * packages;
+    }
+}
+
+/*
+ * Leaves in order of weight and the nodes merged from them both come out
+ * sorted, so each merge takes the two lightest heads of the two queues.
+ * Lengths past max_length are cut to it, then the Kraft sum is brought back
+ * to 1 by dropping a code of max_length and splitting the longest shorter
+ * code in two, as miniz does, and the lengths go back to the symbols
+ * shortest first.
+ */
+void Symbols::fill_lengths_heuristic(std::size_t max_length) {
+    if (size_ <= 1) {
+        if (size_ == 1) {
+            symbols_[0].length_ = 1;
         }
-        items.swap(packaged_items);
-        for (std::size_t i = 0; i < size_; ++i) {
-            items.emplace_back(&symbols_[i]);
+        return;
+    }
+    std::sort(symbols_.begin(), symbols_.begin() + size_,
+              [](const Symbol &lhs, const Symbol &rhs) {
+                  return lhs.weight_ < rhs.weight_;
+              });
+    // node i is merged i-th, its parent is a later node
+    std::array<uint64_t, 255> weights;
+    std::array<uint8_t, 255> parents;
+    std::array<uint8_t, 256> leaf_parents;
+    std::size_t leaf = 0;
+    std::size_t node = 0;
+    std::size_t nodes = size_ - 1;
+    for (std::size_t i = 0; i < nodes; ++i) {
+        uint64_t weight = 0;
+        for (int child = 0; child < 2; ++child) {
+            if (leaf < size_ &&
+                (node == i || symbols_[leaf].weight_ <= weights[node])) {
+                weight += symbols_[leaf].weight_;
+                leaf_parents[leaf++] = i;
+            } else {
+                weight += weights[node];
+                parents[node++] = i;
+            }
         }
+        weights[i] = weight;
     }
-    std::sort(items.begin(), items.end());
-    for (std::size_t i = 0; i < cutoff; ++i) {
-        for (Symbol *&symbol : items[i].symbols_) {
-            ++symbol->length_;
+    // depths of the nodes, root last, then codes per length
+    std::array<uint8_t, 255> depths;
+    depths[nodes - 1] = 0;
+    for (std::size_t i = nodes - 1; i-- > 0;) {
+        depths[i] = depths[parents[i]] + 1;
+    }
+    std::array<std::size_t, 257> lengths = {0};
+    for (std::size_t i = 0; i < size_; ++i) {
+        ++lengths[std::min<std::size_t>(depths[leaf_parents[i]] + 1,
+                                        max_length)];
+    }
+    std::size_t kraft = 0;  // in units of 2^-max_length
+    for (std::size_t length = 1; length <= max_length; ++length) {
+        kraft += lengths[length] << (max_length - length);
+    }
+    for (; kraft > std::size_t{1} << max_length; --kraft) {
+        --lengths[max_length];
+        for (std::size_t length = max_length - 1; length > 0; --length) {
+            if (lengths[length] != 0) {
+                --lengths[length];
+                lengths[length + 1] += 2;
+                break;
+            }
+        }
+    }
+    for (std::size_t length = max_length, i = 0; length > 0; --length) {
+        for (std::size_t j = 0; j < lengths[length]; ++j) {
+            symbols_[i++].length_ = length;
         }
     }
 }
 
-BitVector *Symbols::generate_codes() {
-    BitVector *codes = new BitVector[256];
+void Symbols::generate_codes(std::array<BitVector, 256> &codes) {
+    codes.fill(BitVector());
 
     if (size_ == 0) {
-        codes[symbols_[0].value_].zero(1);
-        return codes;
+        return;
     }
 
     BitVector code;
-    std::sort(symbols_, symbols_ + size_,
+    std::sort(symbols_.begin(), symbols_.begin() + size_,
               [](const Symbol &lhs, const Symbol &rhs) {
                   if (lhs.length_ == rhs.length_) {
                       return lhs.value_ < rhs.value_;
@@ -115,431 +208,1413 @@ BitVector *Symbols::generate_codes() {
         code.next(length);
     }
     codes[symbols_[size_ - 1].value_] = code;
-    return codes;
 }
 
-Symbol *Symbols::data() { return symbols_; }
+Symbol *Symbols::data() { return symbols_.data(); }
 
 std::size_t Symbols::size() const { return size_; }
 
+std::size_t Symbols::encoded_bits() const {
+    std::size_t bits = 0;
+    for (std::size_t i = 0; i < size_; ++i) {
+        bits += symbols_[i].weight_ * symbols_[i].length_;
+    }
+    return bits;
+}
+
 /**
- * Processor
+ * Profile
  */
 
-void Serial::Processor::encode(std::string pathname,
-                               std::string encoded_pathname) {
-    IByteStream ibs(pathname);
+Profile::Scope::Scope(Profile *profile, Stage stage)
+    : profile_(profile), stage_(stage) {
+    if (profile_ != nullptr && profile_->counters_ != nullptr) {
+        start_ = profile_->counters_->read();
+        bench_.reset();
+    }
+}
 
-    Symbols symbols;
-    {
-        std::array<std::size_t, 256> counts = {0};  // assuming only ASCII
-        for (std::size_t i = 0; i < ibs.size(); ++i) {
-            ++counts[ibs[i]];
-        }
-        symbols.initialize(256 - std::count(counts.begin(), counts.end(), 0));
-        for (std::size_t i = 0, end = 0; i < 256; ++i) {
-            if (counts[i] != 0) {
-                std::size_t j = end++;
-                symbols[j] = {
-                    .weight_ = counts[i],
-                    .value_ = static_cast<uint8_t>(i),
-                    .length_ = 0,
-                };
+Profile::Scope::~Scope() {
+    if (profile_ == nullptr) {
+        return;
+    }
+    std::size_t stage = static_cast<std::size_t>(stage_);
+    profile_->seconds_[stage] += bench_.elapsed();
+    if (profile_->counters_ != nullptr) {
+        std::vector<Counters::Values> end = profile_->counters_->read();
+        std::vector<Counters::Values> &counts = profile_->counts_[stage];
+        counts.resize(end.size(), Counters::Values{0});
+        for (std::size_t i = 0; i < end.size(); ++i) {
+            for (std::size_t j = 0; j < Counters::events; ++j) {
+                counts[i][j] += end[i][j] - start_[i][j];
             }
         }
     }
+}
 
-    symbols.fill_lengths();
-    BitVector *codes = symbols.generate_codes();
+Profile::Profile(Counters *counters) : counters_(counters) {}
 
-    // write
-    {
-        std::size_t encoded_size;
-        {
-            std::size_t bits_used = header_bits;
-            for (std::size_t i = 0; i < symbols.size(); ++i) {
-                bits_used += symbols[i].weight_ * symbols[i].length_;
+double Profile::operator[](Stage stage) const {
+    return seconds_[static_cast<std::size_t>(stage)];
+}
+
+const std::vector<Counters::Values> &Profile::counts(Stage stage) const {
+    return counts_[static_cast<std::size_t>(stage)];
+}
+
+/**
+ * Processor
+ */
+
+namespace {
+
+// level 1 counts fast_span bytes of every fast_stride
+constexpr std::size_t fast_span = 1 << 12;
+constexpr std::size_t fast_stride = 1 << 14;
+// level 3 decides where members start at segments of this many blocks
+constexpr std::size_t split_blocks = 16;
+
+std::size_t block_count(std::size_t size, std::size_t block_size) {
+    return (size + block_size - 1) / block_size;
+}
+
+// blocks per window under max_memory, counting each decoded byte plus up to
+// two encoded ones, in whole groups of lanes
+std::size_t window_blocks(std::size_t max_memory, std::size_t block_size,
+                          std::size_t blocks) {
+    if (max_memory == 0) {
+        return std::max<std::size_t>(blocks, 1);
+    }
+    return std::max(max_memory / (3 * block_size) / lanes * lanes, lanes);
+}
+
+// decoded and encoded bytes async decode keeps in flight without max_memory
+constexpr std::size_t async_memory = 256 << 20;
+// windows in flight, each decoded while the others are read or written
+constexpr std::size_t async_slots = 4;
+// one read and one write at a time
+constexpr std::size_t async_io_threads = 2;
+
+int team_size(const Options &options) {
+    return options.threads > 0 ? options.threads : omp_get_max_threads();
+}
+
+/*
+ * Places the threads of a parallel call and sets the schedule its block
+ * loops run with, schedule(runtime), restoring the caller's schedule and
+ * CPU mask, on every thread of the team, on the way out
+ */
+class Placement {
+    omp_sched_t kind_;
+    int chunk_;
+    int pinned_ = 0;  // threads pinned, given the caller's mask_ back
+    cpu_set_t mask_;
+
+   public:
+    Placement(const Options &options, bool parallel) {
+        omp_get_schedule(&kind_, &chunk_);
+        omp_set_schedule(
+            options.numa_local ? omp_sched_static : omp_sched_dynamic, 0);
+        if (parallel) {
+            int threads = team_size(options);
+            if (options.pin &&
+                sched_getaffinity(0, sizeof(mask_), &mask_) == 0) {
+                pinned_ = threads;
             }
-            encoded_size = (bits_used + 7) / 8;
+            place_threads(threads, options.pin);
         }
-        if (encoded_size > ibs.size()) {
-            println(
-                "sloth: compressed file will be larger than original "
-                "hahaha");
+    }
+    ~Placement() {
+        if (pinned_ != 0) {
+            place_threads(pinned_, mask_);
         }
+        omp_set_schedule(kind_, chunk_);
+    }
+    Placement(const Placement &) = delete;
+    Placement &operator=(const Placement &) = delete;
+};
 
-        OByteStream obs(encoded_pathname, encoded_size);
-        uint8_t *obs_map = obs.map();
-
-        // header
+// reads the first span bytes of every stride of the input from offset on,
+// returns the bytes read. Under max_memory, windows of spans are released
+// once counted, each covering at most max_memory bytes of the input since
+// fault-around maps in pages between the spans too
+std::size_t histogram(const IByteStream &ibs, std::size_t offset,
+                      std::size_t span, std::size_t stride,
+                      const Options &options, bool parallel,
+                      std::array<std::size_t, 256> &counts) {
+    const uint8_t *in = ibs.map() + offset;
+    std::size_t size = ibs.size() - offset;
+    std::size_t max_memory = options.max_memory;
+    int threads = team_size(options);
+    std::size_t spans = (size + stride - 1) / stride;
+    std::size_t window = std::max<std::size_t>(
+        max_memory == 0 ? spans : max_memory / stride, 1);
+    std::size_t sampled = 0;
+    for (std::size_t first = 0; first < spans; first += window) {
+        std::size_t last = std::min(first + window, spans);
+#pragma omp parallel if (parallel) num_threads(threads) reduction(+ : sampled)
         {
-            /*
-             * 0-7: old size
-             * 8-263: code lengths
-             */
-            std::size_t old_size = ibs.size();
-            std::memcpy(obs_map, &old_size, 8);
-
-            // trie using DEFLATE spec
-            // https://www.ietf.org/rfc/rfc1951.txt
-            for (std::size_t i = 0; i < 256; ++i) {
-                uint8_t code_size =
-                    codes[i].size();  // max code size is 255 since ASCII
-                std::memcpy(obs_map + i + 8, &code_size, 1);
+            std::array<std::size_t, 256> _counts = {0};
+#pragma omp for nowait schedule(static)
+            for (std::size_t i = first; i < last; ++i) {
+                std::size_t begin = i * stride;
+                std::size_t end = std::min(begin + span, size);
+                for (std::size_t j = begin; j < end; ++j) {
+                    ++_counts[in[j]];
+                }
+                sampled += end - begin;
+            }
+#pragma omp critical
+            {
+                for (std::size_t i = 0; i < 256; ++i) {
+                    counts[i] += _counts[i];
+                }
             }
         }
-
-        // body
-        std::size_t bits_used = header_bits;
-        for (std::size_t i = 0; i < ibs.size(); ++i) {
-            uint8_t value = ibs[i];
-            BitVector &code = codes[value];
-            code.copy(obs_map + bits_used / 8, bits_used % 8);
-            bits_used += code.size();
+        if (max_memory != 0) {
+            ibs.release(offset + first * stride,
+                        offset + std::min((last - 1) * stride + span,
+                                          size));
         }
-        assert(encoded_size == (bits_used + 7) / 8);
-        println("sloth: Compression ratio: {:.2f}",
-                ibs.size() / static_cast<double>(encoded_size));
     }
+    return sampled;
 }
 
-void Serial::Processor::decode(std::string encoded_pathname,
-                               std::string decoded_pathname) {
-    IByteStream ibs(encoded_pathname);
-    const uint8_t *ibs_map = ibs.map();
-    std::size_t encoded_size = ibs.size();
+// reverses the low size bits of value
+uint32_t reverse_bits(uint32_t value, std::size_t size) {
+    uint32_t reversed = 0;
+    for (std::size_t i = 0; i < size; ++i, value >>= 1) {
+        reversed = reversed << 1 | (value & 1);
+    }
+    return reversed;
+}
 
-    std::size_t decoded_size = 0;
-    std::memcpy(&decoded_size, ibs_map, 8);
+Layout layout(const Header &header) {
+    return header.flags & lsb_first_flag ? Layout::lsb_first
+                                         : Layout::msb_first;
+}
 
-    std::array<uint8_t, 256> code_lengths;
-    std::memcpy(code_lengths.data(), ibs_map + 8, 256);
-    {
-        std::pair<uint8_t, std::size_t> barriers[256] = {{0, 0}};
-        Symbols symbols;
-        symbols.initialize(
-            256 - std::count(code_lengths.begin(), code_lengths.end(), 0));
-        for (std::size_t i = 0, symbols_i = 0; i < 256; ++i) {
-            if (code_lengths[i] != 0) {
-                symbols[symbols_i++] = {
-                    .weight_ = 0,
-                    .value_ = static_cast<uint8_t>(i),
-                    .length_ = code_lengths[i],
-                };
+/*
+ * Points the context at the tables of code_lengths in layout, taken from
+ * the cache or built and added to it. False when the lengths do not form a
+ * prefix code the tables can hold.
+ */
+bool load_tables(const std::array<uint8_t, 256> &code_lengths, Layout layout,
+                 Context &context) {
+    TableCache &cache = TableCache::get();
+    if ((context.tables_ = cache.find(code_lengths, layout))) {
+        return true;
+    }
+    std::size_t table_width =
+        width(*std::max_element(code_lengths.begin(), code_lengths.end()));
+    if (table_width == 0) {
+        return false;
+    }
+    std::size_t kraft = 0;  // in units of 2^-width
+    for (uint8_t length : code_lengths) {
+        if (length != 0) {
+            kraft += 1 << (table_width - length);
+        }
+    }
+    if (kraft == 0 || kraft > (1u << table_width)) {
+        return false;
+    }
+
+    Symbols &symbols = context.symbols_;
+    symbols.initialize(
+        256 - std::count(code_lengths.begin(), code_lengths.end(), 0));
+    for (std::size_t i = 0, symbols_i = 0; i < 256; ++i) {
+        if (code_lengths[i] != 0) {
+            symbols[symbols_i++] = {
+                .weight_ = 0,
+                .value_ = static_cast<uint8_t>(i),
+                .length_ = code_lengths[i],
+            };
+        }
+    }
+    std::array<BitVector, 256> &codes = context.codes_;
+    symbols.generate_codes(codes);
+    std::shared_ptr<Tables> tables = std::make_shared<Tables>();
+    tables->code_lengths = code_lengths;
+    tables->layout = layout;
+    bool reversed = layout == Layout::lsb_first;
+    tables->encode.layout = layout;
+    tables->encode.width = table_width;
+    for (std::size_t i = 0; i < 256; ++i) {
+        uint32_t code = reversed
+                            ? reverse_bits(codes[i].value(), codes[i].size())
+                            : codes[i].value();
+        tables->encode.codes[i] = code << 8 | codes[i].size();
+    }
+    // every prefix starting with a code decodes to it, MSB-first they are
+    // one run of entries, LSB-first every 2^length-th entry
+    DecodeTable &table = tables->decode;
+    table.layout = layout;
+    table.width = table_width;
+    table.entries.assign((1 << table.width) + 1, 0);
+    for (std::size_t i = 0; i < symbols.size(); ++i) {
+        const BitVector &code = codes[symbols[i].value_];
+        uint16_t entry = symbols[i].value_ | code.size() << 8;
+        if (reversed) {
+            for (std::size_t j = reverse_bits(code.value(), code.size());
+                 j < (1u << table.width); j += 1 << code.size()) {
+                table.entries[j] = entry;
             }
+        } else {
+            std::size_t spare = table.width - code.size();
+            std::fill_n(table.entries.begin() + (code.value() << spare),
+                        1 << spare, entry);
         }
-        BitVector *codes = symbols.generate_codes();
-        for (std::size_t i = 0; i < symbols.size() - 1; ++i) {
-            uint8_t value_a = symbols[i].value_;
-            BitVector &code_a = codes[value_a];
-            uint8_t barrier_a = static_cast<uint8_t>(code_a.value())
-                                << (8 - code_a.size());
+    }
+    context.tables_ = cache.insert(std::move(tables));
+    return true;
+}
 
-            uint8_t value_b = symbols[i + 1].value_;
-            BitVector &code_b = codes[value_b];
-            uint8_t barrier_b = static_cast<uint8_t>(code_b.value())
-                                << (8 - code_b.size());
+/*
+ * Decodes blocks [first, first + count) into out, reading them from in,
+ * which holds bytes [in_begin, in_end) of the body. A full group of lanes
+ * blocks goes through the vector kernel for as many symbols as every block
+ * has and can read without leaving in, the scalar loop finishes the rest.
+ */
+void decode_group(const Header &header, const uint8_t *in,
+                  std::size_t in_begin, std::size_t in_end,
+                  const DecodeTable &table, std::size_t first,
+                  std::size_t count, uint8_t *const out[lanes]) {
+    std::size_t symbols = 0;
+    std::array<std::size_t, lanes> bits_read = {0};
+    // cursors are 32-bit bit offsets from the group's first block
+    std::size_t span = in_end - header.begin(first);
+    if (kernel() == Kernel::avx2 && count == lanes && span < (1u << 28)) {
+        std::array<uint32_t, lanes> cursors;
+        symbols = SIZE_MAX;
+        for (std::size_t i = 0; i < lanes; ++i) {
+            std::size_t block = first + i;
+            cursors[i] = (header.begin(block) - header.begin(first)) * 8;
+            // codes are at most width bits, the last window read is 4 bytes
+            std::size_t readable = span * 8 - cursors[i];
+            symbols = std::min({
+                symbols,
+                header.decoded_end(block) - header.decoded_begin(block),
+                readable < 32 ? 0 : (readable - 32) / table.width,
+            });
+        }
+        symbols -= symbols % 4;
+        decode_avx2(table, in + (header.begin(first) - in_begin),
+                    cursors.data(), out, symbols);
+        for (std::size_t i = 0; i < lanes; ++i) {
+            std::size_t begin = header.begin(first + i) - header.begin(first);
+            bits_read[i] = cursors[i] - begin * 8;
+        }
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+        std::size_t block = first + i;
+        std::size_t out_size =
+            header.decoded_end(block) - header.decoded_begin(block);
+        decode_block(table, in + (header.begin(block) - in_begin),
+                     header.end(block) - header.begin(block), out[i] + symbols,
+                     out_size - symbols, bits_read[i]);
+    }
+}
 
-            for (std::size_t j = barrier_a; j < barrier_b; ++j) {
-                barriers[j] = {value_a, code_a.size()};
+/*
+ * Decodes and checks blocks [first, last) from in, as for decode_group, to
+ * out, which holds decoded bytes from out_begin on. The first corrupt block
+ * found is stored in corrupt, which stops the remaining groups.
+ */
+void decode_blocks(const Header &header, const uint8_t *in,
+                   std::size_t in_begin, std::size_t in_end,
+                   const DecodeTable &table, std::size_t first,
+                   std::size_t last, uint8_t *out, std::size_t out_begin,
+                   bool parallel, int threads,
+                   std::atomic<std::size_t> &corrupt) {
+    std::size_t blocks = header.blocks();
+#pragma omp parallel for if (parallel) num_threads(threads) schedule(runtime)
+    for (std::size_t i = first; i < last; i += lanes) {
+        if (corrupt.load(std::memory_order_relaxed) != blocks) {
+            continue;  // fail fast, stop decoding the remaining blocks
+        }
+        std::size_t count = std::min(lanes, last - i);
+        uint8_t *group[lanes];
+        for (std::size_t j = 0; j < count; ++j) {
+            group[j] = out + (header.decoded_begin(i + j) - out_begin);
+        }
+        decode_group(header, in, in_begin, in_end, table, i, count, group);
+        for (std::size_t j = 0; j < count; ++j) {
+            std::size_t block = i + j;
+            if (xxhash64(group[j], header.decoded_end(block) -
+                                       header.decoded_begin(block)) !=
+                header.checksums[block]) {
+                corrupt.store(block, std::memory_order_relaxed);
+                break;
             }
         }
-        {
-            Symbol &symbol = symbols[symbols.size() - 1];
-            BitVector &code = codes[symbol.value_];
-            uint8_t barrier =
-                (static_cast<uint8_t>(code.value()) << (8 - code.size()));
-            for (std::size_t i = barrier; i < 256; ++i) {
-                barriers[i] = {symbol.value_, code.size()};
+    }
+}
+
+/*
+ * Counts the input from offset on into context.counts_ and fills the code
+ * lengths of context.symbols_ from them, as encode at options.level does.
+ * Returns the bytes counted.
+ */
+std::size_t fill_code(Context &context, const IByteStream &ibs,
+                      std::size_t offset, bool parallel, Profile *profile) {
+    std::size_t size = ibs.size() - offset;
+    const Options &options = context.options_;
+    Symbols &symbols = context.symbols_;
+    bool fast = options.level <= min_level;
+    std::size_t sampled;
+    {
+        Profile::Scope scope(profile, Stage::histogram);
+        context.counts_.fill(0);
+        sampled = fast ? histogram(ibs, offset, fast_span, fast_stride,
+                                   options, parallel, context.counts_)
+                       : histogram(ibs, offset, sample_span, sample_span,
+                                   options, parallel, context.counts_);
+        // bytes left out of the sample may be any value, every one needs a
+        // code
+        if (sampled < size) {
+            for (std::size_t &count : context.counts_) {
+                count = std::max<std::size_t>(count, 1);
             }
         }
+        symbols.initialize(context.counts_);
+    }
+    Profile::Scope scope(profile, Stage::lengths);
+    if (fast) {
+        symbols.fill_lengths_heuristic(code_length_limit);
+    } else {
+        symbols.fill_lengths(code_length_limit);
+    }
+    return sampled;
+}
 
-        OByteStream obs(decoded_pathname + ".res", decoded_size);
-        uint8_t *obs_map = obs.map();
+/*
+ * Encodes the input from offset on as one member, written to the stream
+ * open returns for the member's size, and returns that size
+ */
+template <typename Open>
+std::size_t encode(Context &context, const IByteStream &ibs,
+                   std::size_t offset, Open &&open, bool parallel,
+                   Profile *profile) {
+    const uint8_t *in = ibs.map() + offset;
+    std::size_t size = ibs.size() - offset;
+    const Options &options = context.options_;
+    std::size_t max_memory = options.max_memory;
+    int threads = team_size(options);
+    Placement placement(options, parallel);
 
-        std::size_t bits_read = header_bits;
-        for (size_t i = 0; i < decoded_size; ++i) {
-            std::size_t byte_offset = bits_read / 8;
-            uint8_t byte_1 = ibs[byte_offset];
-            uint8_t byte_2 = 0;
-            if (byte_offset - 1 < encoded_size) {
-                byte_2 = ibs[byte_offset + 1];
+    Symbols &symbols = context.symbols_;
+    fill_code(context, ibs, offset, parallel, profile);
+    Header &header = context.header_;
+    {
+        Profile::Scope scope(profile, Stage::codes);
+        header.code_lengths.fill(0);
+        for (std::size_t i = 0; i < symbols.size(); ++i) {
+            header.code_lengths[symbols[i].value_] = symbols[i].length_;
+        }
+        // an empty input has no blocks, so no code to build tables of
+        [[maybe_unused]] bool loaded =
+            size == 0 ||
+            load_tables(header.code_lengths, options.layout, context);
+        assert(loaded);
+    }
+
+    // write
+    Profile::Scope scope(profile, Stage::emit);
+    header.flags = options.layout == Layout::lsb_first ? lsb_first_flag : 0;
+    header.decoded_size = size;
+    header.block_size = block_size;
+    std::size_t padding =
+        options.layout == Layout::lsb_first ? lsb_padding : 0;
+    std::size_t blocks = block_count(size, block_size);
+    std::size_t window = window_blocks(max_memory, block_size, blocks);
+    header.offsets.assign(blocks + 1, 0);
+    header.checksums.resize(blocks);
+    for (std::size_t first = 0; first < blocks; first += window) {
+        std::size_t last = std::min(first + window, blocks);
+#pragma omp parallel for if (parallel) num_threads(threads) schedule(runtime)
+        for (std::size_t i = first; i < last; ++i) {
+            std::size_t begin = header.decoded_begin(i);
+            std::size_t end = header.decoded_end(i);
+            std::size_t bits = 0;
+            for (std::size_t j = begin; j < end; ++j) {
+                bits += header.code_lengths[in[j]];
             }
+            header.offsets[i + 1] = (bits + 7) / 8 + padding;
+            header.checksums[i] = xxhash64(in + begin, end - begin);
+        }
+        if (max_memory != 0) {
+            ibs.release(offset + header.decoded_begin(first),
+                        offset + header.decoded_end(last - 1));
+        }
+    }
+    for (std::size_t i = 0; i < blocks; ++i) {
+        header.offsets[i + 1] += header.offsets[i];
+    }
+    std::vector<uint8_t> &serialized = context.serialized_;
+    header.serialize(serialized);
+    std::size_t encoded_size = serialized.size() + header.offsets[blocks];
 
-            std::size_t bit_offset = bits_read % 8;
-            byte_1 <<= bit_offset;
-            byte_2 >>= (8 - bit_offset);
-            uint8_t byte = byte_1 | byte_2;
+    OByteStream obs = open(encoded_size);
+    uint8_t *obs_map = obs.map();
+    std::memcpy(obs_map, serialized.data(), serialized.size());
 
-            std::pair<uint8_t, std::size_t> barrier = barriers[byte];
-            std::memcpy(obs_map + i, &(barrier.first), 1);
-            bits_read += barrier.second;
+    // body, every block starts on a byte boundary so no two blocks share one
+    uint8_t *body = obs_map + serialized.size();
+    for (std::size_t first = 0; first < blocks; first += window) {
+        std::size_t last = std::min(first + window, blocks);
+#pragma omp parallel for if (parallel) num_threads(threads) schedule(runtime)
+        for (std::size_t i = first; i < last; ++i) {
+            [[maybe_unused]] std::size_t written = encode_block(
+                context.tables_->encode, in + header.decoded_begin(i),
+                header.decoded_end(i) - header.decoded_begin(i),
+                body + header.begin(i));
+            assert(written == header.end(i) - header.begin(i));
+        }
+        if (max_memory != 0) {
+            ibs.release(offset + header.decoded_begin(first),
+                        offset + header.decoded_end(last - 1));
+            obs.release(serialized.size() + header.begin(first),
+                        serialized.size() + header.end(last - 1));
         }
     }
+    return encoded_size;
 }
 
-void Parallel::Processor::encode(std::string pathname,
-                                 std::string encoded_pathname) {
-    IByteStream ibs(pathname);
+// bits of a member coding counts with a code of its own, header included.
+// Every field the header is sized by is set here, not left from the last
+// call, so the same input always splits the same way
+std::size_t member_bits(Context &context,
+                        const std::array<std::size_t, 256> &counts) {
+    Symbols &symbols = context.symbols_;
+    symbols.initialize(counts);
+    symbols.fill_lengths(code_length_limit);
+    Header &header = context.header_;
+    header.flags =
+        context.options_.layout == Layout::lsb_first ? lsb_first_flag : 0;
+    header.decoded_size = std::accumulate(counts.begin(), counts.end(),
+                                          std::size_t{0});
+    header.block_size = block_size;
+    header.code_lengths.fill(0);
+    for (std::size_t i = 0; i < symbols.size(); ++i) {
+        header.code_lengths[symbols[i].value_] = symbols[i].length_;
+    }
+    header.offsets.assign(1, 0);
+    header.checksums.clear();
+    header.serialize(context.serialized_);
+    return symbols.encoded_bits() + 8 * context.serialized_.size();
+}
 
-    Symbols symbols;
+/*
+ * Cuts the input from offset on into segments of split_blocks blocks and
+ * groups them greedily into runs: a run takes the next segment while coding
+ * both with one code costs fewer bits than two members. Leaves the offset
+ * of every run from offset in context.runs_.
+ */
+void split(Context &context, const IByteStream &ibs, std::size_t offset,
+           bool parallel, Profile *profile) {
+    const uint8_t *in = ibs.map() + offset;
+    std::size_t size = ibs.size() - offset;
+    const Options &options = context.options_;
+    std::size_t segment_size = split_blocks * block_size;
+    std::size_t segments = block_count(size, segment_size);
+    std::vector<std::size_t> &runs = context.runs_;
+    runs.assign(1, 0);
+    if (segments < 2) {
+        return;
+    }
+
+    std::vector<std::array<std::size_t, 256>> &counts =
+        context.segment_counts_;
     {
-        std::array<std::size_t, 256> counts = {0};  // assuming only ASCII
-#pragma omp parallel
-        {
-            std::array<std::size_t, 256> _counts = {0};
-#pragma omp for nowait schedule(static, Sizes::page)
-            for (std::size_t i = 0; i < ibs.size(); ++i) {
-                ++_counts[ibs[i]];
+        Profile::Scope scope(profile, Stage::histogram);
+        counts.assign(segments, {0});
+#pragma omp parallel for if (parallel) num_threads(team_size(options)) \
+    schedule(dynamic)
+        for (std::size_t i = 0; i < segments; ++i) {
+            std::size_t begin = i * segment_size;
+            std::size_t end = std::min(begin + segment_size, size);
+            for (std::size_t j = begin; j < end; ++j) {
+                ++counts[i][in[j]];
             }
-#pragma omp critical
-            {
-                for (std::size_t i = 0; i < 256; ++i) {
-                    counts[i] += _counts[i];
-                }
+            if (options.max_memory != 0) {
+                ibs.release(offset + begin, offset + end);
             }
         }
-        symbols.initialize(256 - std::count(counts.begin(), counts.end(), 0));
-        for (std::size_t i = 0, end = 0; i < 256; ++i) {
-            if (counts[i] != 0) {
-                std::size_t j = end++;
-                symbols[j] = {
-                    .weight_ = counts[i],
-                    .value_ = static_cast<uint8_t>(i),
-                    .length_ = 0,
-                };
-            }
+    }
+    Profile::Scope scope(profile, Stage::lengths);
+    std::array<std::size_t, 256> run = counts[0];
+    std::size_t run_bits = member_bits(context, run);
+    for (std::size_t i = 1; i < segments; ++i) {
+        std::array<std::size_t, 256> merged;
+        for (std::size_t j = 0; j < 256; ++j) {
+            merged[j] = run[j] + counts[i][j];
+        }
+        std::size_t merged_bits = member_bits(context, merged);
+        std::size_t segment_bits = member_bits(context, counts[i]);
+        if (merged_bits <= run_bits + segment_bits) {
+            run = merged;
+            run_bits = merged_bits;
+        } else {
+            runs.push_back(i * segment_size);
+            run = counts[i];
+            run_bits = segment_bits;
         }
     }
+}
+
+/*
+ * Encodes the input from offset on at the context's level, as one member
+ * or, at max_level, one per run of split. Each is written to the stream
+ * open(size, at) returns for its size bytes at byte at of the output.
+ * Returns the bytes written.
+ */
+template <typename Open>
+std::size_t encode_members(Context &context, const IByteStream &ibs,
+                           std::size_t offset, Open &&open, bool parallel,
+                           Profile *profile) {
+    if (context.options_.level < max_level) {
+        return encode(
+            context, ibs, offset,
+            [&](std::size_t size) { return open(size, 0); }, parallel,
+            profile);
+    }
+    split(context, ibs, offset, parallel, profile);
+    const std::vector<std::size_t> &runs = context.runs_;
+    std::size_t size = ibs.size() - offset;
+    std::size_t written = 0;
+    for (std::size_t i = 0; i < runs.size(); ++i) {
+        std::size_t end = i + 1 < runs.size() ? runs[i + 1] : size;
+        IByteStream run(ibs, offset + runs[i], end - runs[i]);
+        std::size_t member_size = encode(
+            context, run, 0,
+            [&](std::size_t size) { return open(size, written); }, parallel,
+            profile);
+        written += member_size;
+    }
+    return written;
+}
 
-    symbols.fill_lengths();
-    BitVector *codes = symbols.generate_codes();
+// bytes of a member of size decoded bytes coded with the lengths of
+// context.symbols_, for bytes counted in counts, with every block rounded up
+// to a whole byte
+std::size_t member_size(Context &context,
+                        const std::array<std::size_t, 256> &counts,
+                        std::size_t size) {
+    const Options &options = context.options_;
+    Symbols &symbols = context.symbols_;
+    Header &header = context.header_;
+    header.flags = options.layout == Layout::lsb_first ? lsb_first_flag : 0;
+    header.decoded_size = size;
+    header.block_size = block_size;
+    header.code_lengths.fill(0);
+    for (std::size_t i = 0; i < symbols.size(); ++i) {
+        header.code_lengths[symbols[i].value_] = symbols[i].length_;
+    }
+    std::size_t bits = 0;
+    for (std::size_t i = 0; i < 256; ++i) {
+        bits += counts[i] * header.code_lengths[i];
+    }
+    std::size_t padding =
+        options.layout == Layout::lsb_first ? lsb_padding : 0;
+    std::size_t blocks = block_count(size, block_size);
+    std::size_t body_size = (bits + 7 * blocks) / 8 + padding * blocks;
+    // spread the body evenly to size the block index
+    header.offsets.resize(blocks + 1);
+    header.checksums.resize(blocks);
+    for (std::size_t i = 0; i <= blocks; ++i) {
+        header.offsets[i] = blocks == 0 ? 0 : body_size * i / blocks;
+    }
+    header.serialize(context.serialized_);
+    return context.serialized_.size() + body_size;
+}
 
-    // write
+/*
+ * Predicts what encode would write with the context's options, from the
+ * counts of a sample scaled to the input, coded as options.level codes.
+ * With every byte read, level 1 takes the code encode would build from its
+ * own sample, and level 3 splits the input as encode does and predicts each
+ * run as a member.
+ */
+Estimate estimate(Context &context, const IByteStream &ibs, double fraction,
+                  bool parallel, Profile *profile) {
+    const Options &options = context.options_;
+    std::size_t size = ibs.size();
+    Symbols &symbols = context.symbols_;
+    if (options.level >= max_level && fraction >= 1) {
+        split(context, ibs, 0, parallel, profile);
+        const std::vector<std::size_t> &runs = context.runs_;
+        if (runs.size() > 1) {
+            Profile::Scope scope(profile, Stage::lengths);
+            std::size_t segment_size = split_blocks * block_size;
+            std::size_t encoded_size = 0;
+            for (std::size_t i = 0; i < runs.size(); ++i) {
+                std::size_t end = i + 1 < runs.size() ? runs[i + 1] : size;
+                std::array<std::size_t, 256> counts = {0};
+                for (std::size_t j = runs[i] / segment_size;
+                     j < block_count(end, segment_size); ++j) {
+                    for (std::size_t k = 0; k < 256; ++k) {
+                        counts[k] += context.segment_counts_[j][k];
+                    }
+                }
+                symbols.initialize(counts);
+                symbols.fill_lengths(code_length_limit);
+                encoded_size += member_size(context, counts, end - runs[i]);
+            }
+            return {
+                .size = size,
+                .sampled = size,
+                .encoded_size = encoded_size,
+            };
+        }
+    }
+
+    // a tiny fraction reads one span, its stride past the input may not
+    // fit a size_t
+    std::size_t stride =
+        fraction >= 1
+            ? sample_span
+            : static_cast<std::size_t>(std::clamp(
+                  sample_span / fraction, static_cast<double>(sample_span),
+                  static_cast<double>(std::max(size, sample_span))));
+    std::size_t sampled;
+    std::array<std::size_t, 256> counts = {0};
     {
-        std::size_t encoded_size;
-        {
-            std::size_t bits_used = header_bits;
-            for (std::size_t i = 0; i < symbols.size(); ++i) {
-                bits_used += symbols[i].weight_ * symbols[i].length_;
+        Profile::Scope scope(profile, Stage::histogram);
+        sampled = histogram(ibs, 0, sample_span, stride, options, parallel,
+                            counts);
+        if (sampled < size) {
+            double scale = static_cast<double>(size) / sampled;
+            for (std::size_t &count : counts) {
+                if (count != 0) {
+                    count = std::max<std::size_t>(1, count * scale + 0.5);
+                }
             }
-            encoded_size = (bits_used + 7) / 8;
         }
-        if (encoded_size > ibs.size()) {
-            println(
-                "sloth: compressed file will be larger than original "
-                "hahaha");
+    }
+    if (options.level <= min_level && fraction >= 1) {
+        fill_code(context, ibs, 0, parallel, profile);
+    } else {
+        Profile::Scope scope(profile, Stage::lengths);
+        symbols.initialize(counts);
+        if (options.level <= min_level) {
+            symbols.fill_lengths_heuristic(code_length_limit);
+        } else {
+            symbols.fill_lengths(code_length_limit);
         }
+    }
+    return {
+        .size = size,
+        .sampled = sampled,
+        .encoded_size = member_size(context, counts, size),
+    };
+}
 
-        OByteStream obs(encoded_pathname, encoded_size);
-        uint8_t *obs_map = obs.map();
+/*
+ * Parses every member of the file into the context and loads their tables.
+ * Returns the first inconsistency found, prefixed with the byte offset of
+ * its member unless that is the first one, and empty when there is none
+ */
+std::string read_members(Context &context, const IByteStream &ibs) {
+    std::vector<Member> &members = context.members_;
+    std::size_t count = 0;
+    std::size_t offset = 0;
+    std::size_t decoded = 0;
+    std::size_t blocks = 0;
+    do {
+        if (count == members.size()) {
+            members.emplace_back();
+        }
+        Member &member = members[count++];
+        Header &header = member.header_;
+        std::string error =
+            Header::parse(ibs.map() + offset, ibs.size() - offset, header);
+        if (error.empty() && header.blocks() != 0 &&
+            !load_tables(header.code_lengths, layout(header), context)) {
+            error = "invalid code lengths";
+        }
+        if (!error.empty()) {
+            members.clear();
+            return offset == 0
+                       ? error
+                       : std::format("member at byte {}: {}", offset, error);
+        }
+        member.tables_ = header.blocks() != 0 ? context.tables_ : nullptr;
+        member.offset_ = offset;
+        member.decoded_offset_ = decoded;
+        member.first_block_ = blocks;
+        offset += header.member_size();
+        decoded += header.decoded_size;
+        blocks += header.blocks();
+    } while (offset < ibs.size());
+    members.resize(count);
+    return "";
+}
 
-        // header
-        {
-            /*
-             * 0-7: old size
-             * 8-263: code lengths
-             */
-            std::size_t old_size = ibs.size();
-            std::memcpy(obs_map, &old_size, 8);
-
-            // trie using DEFLATE spec
-            // https://www.ietf.org/rfc/rfc1951.txt
-            for (std::size_t i = 0; i < 256; ++i) {
-                uint8_t code_size =
-                    codes[i].size();  // max code size is 255 since ASCII
-                std::memcpy(obs_map + i + 8, &code_size, 1);
+// of every member, which read_members left at least one of
+std::size_t decoded_size(const std::vector<Member> &members) {
+    return members.back().decoded_offset_ +
+           members.back().header_.decoded_size;
+}
+
+std::size_t block_count(const std::vector<Member> &members) {
+    return members.back().first_block_ + members.back().header_.blocks();
+}
+
+[[noreturn]] void exit_corrupt(const std::string &encoded_pathname,
+                               const std::string &decoded_pathname,
+                               std::size_t block) {
+    std::filesystem::remove(decoded_pathname);
+    println("sloth: {} is corrupt: checksum mismatch in block {}",
+            encoded_pathname, block);
+    exit(EXIT_FAILURE);
+}
+
+// decodes every member into obs, returns the first corrupt block or, if
+// there is none, the block count
+std::size_t decode_mapped(Context &context, const IByteStream &ibs,
+                          OByteStream &obs, bool parallel, Profile *profile) {
+    Profile::Scope scope(profile, Stage::decode);
+    std::size_t max_memory = context.options_.max_memory;
+    int threads = team_size(context.options_);
+    for (const Member &member : context.members_) {
+        const Header &header = member.header_;
+        std::size_t blocks = header.blocks();
+        if (blocks == 0) {
+            continue;
+        }
+        const DecodeTable &table = member.tables_->decode;
+        std::size_t body_offset = member.offset_ + header.size;
+        const uint8_t *body = ibs.map() + body_offset;
+        uint8_t *out = obs.map() + member.decoded_offset_;
+        std::size_t window =
+            window_blocks(max_memory, header.block_size, blocks);
+        if (max_memory != 0) {
+            // the index was copied by parse
+            ibs.release(member.offset_, body_offset);
+        }
+        std::atomic<std::size_t> corrupt = blocks;  // none yet
+        for (std::size_t first = 0; first < blocks && corrupt == blocks;
+             first += window) {
+            std::size_t last = std::min(first + window, blocks);
+            decode_blocks(header, body, 0, header.offsets.back(), table, first,
+                          last, out, 0, parallel, threads, corrupt);
+            if (max_memory != 0) {
+                ibs.release(body_offset + header.begin(first),
+                            body_offset + header.end(last - 1));
+                obs.release(
+                    member.decoded_offset_ + header.decoded_begin(first),
+                    member.decoded_offset_ + header.decoded_end(last - 1));
             }
         }
+        if (corrupt != blocks) {
+            return member.first_block_ + corrupt;
+        }
+    }
+    return block_count(context.members_);
+}
 
-        // body
-        if (ibs.size() > Sizes::page * 4) {
-            std::size_t intervals_size =
-                (ibs.size() + Sizes::page - 1) / Sizes::page;
-            std::tuple<std::size_t, std::size_t, std::size_t> *intervals =
-                new std::tuple<std::size_t, std::size_t,
-                               std::size_t>[intervals_size];
-#pragma omp parallel for schedule(static)
-            for (std::size_t i = 0; i < ibs.size(); i += Sizes::page) {
-                std::size_t counts[256] = {0};
-                for (std::size_t j = i; j < i + Sizes::page && j < ibs.size();
-                     ++j) {
-                    uint8_t value = ibs[j];
-                    ++counts[value];
-                }
-                std::size_t interval_bits_used = 0;
-#pragma omp parallel for reduction(+ : interval_bits_used)
-                for (std::size_t j = 0; j < 256; ++j) {
-                    interval_bits_used += counts[j] * codes[j].size();
-                }
-                intervals[i / Sizes::page] = {i, 0, interval_bits_used};
-            }
-            for (std::size_t i = 1; i < intervals_size; ++i) {
-                std::get<1>(intervals[i]) += std::get<2>(intervals[i - 1]);
-                std::get<2>(intervals[i]) += std::get<2>(intervals[i - 1]);
-            }
+/*
+ * State shared by the windows of an asynchronous decode. Each of the slots
+ * owns an encoded and a decoded buffer in the staging area, used by one
+ * window at a time.
+ */
+struct AsyncDecode {
+    IoQueue &io_;
+    int in_fd_;
+    int out_fd_;
+    std::size_t window_;
+    uint8_t *in_;  // slot i at in_ + i * in_stride_
+    std::size_t in_stride_;
+    uint8_t *out_;
+    std::size_t out_stride_;
+    bool parallel_;
+    int threads_;
+    std::size_t corrupt_;  // first corrupt block of the file, or their count
+    int error_ = 0;        // of the first failed read or write
+};
 
-#pragma omp parallel for schedule(dynamic)
-            for (std::size_t i = 0; i < intervals_size; ++i) {
-                std::tuple<std::size_t, std::size_t, std::size_t> &interval =
-                    intervals[i];
-                std::size_t ibs_i = std::get<0>(interval);
-                std::size_t bits_used = header_bits + std::get<1>(interval);
-                for (std::size_t j = ibs_i;
-                     j < ibs_i + Sizes::page && j < ibs.size(); ++j) {
-                    uint8_t value = ibs[j];
-                    BitVector &code = codes[value];
-                    code.copy(obs_map + bits_used / 8, bits_used % 8);
-                    bits_used += code.size();
+// reads the window of the member's blocks from first into the slot,
+// decodes it there and writes it out
+Task decode_window(AsyncDecode &decode, std::size_t slot,
+                   const Member &member, std::size_t first) {
+    const Header &header = member.header_;
+    std::size_t last = std::min(first + decode.window_, header.blocks());
+    std::size_t in_begin = header.begin(first);
+    std::size_t in_end = header.end(last - 1);
+    std::size_t out_begin = header.decoded_begin(first);
+    std::size_t out_end = header.decoded_end(last - 1);
+    uint8_t *in = decode.in_ + slot * decode.in_stride_;
+    uint8_t *out = decode.out_ + slot * decode.out_stride_;
+    if (int error = co_await decode.io_.read(
+            decode.in_fd_, in, in_end - in_begin,
+            member.offset_ + header.size + in_begin)) {
+        decode.error_ = error;
+        co_return;
+    }
+    std::atomic<std::size_t> corrupt = header.blocks();  // none yet
+    decode_blocks(header, in, in_begin, in_end, member.tables_->decode, first,
+                  last, out, out_begin, decode.parallel_, decode.threads_,
+                  corrupt);
+    if (corrupt != header.blocks()) {
+        decode.corrupt_ =
+            std::min(decode.corrupt_, member.first_block_ + corrupt);
+        co_return;
+    }
+    if (int error = co_await decode.io_.write(
+            decode.out_fd_, out, out_end - out_begin,
+            member.decoded_offset_ + out_begin)) {
+        decode.error_ = error;
+    }
+}
+
+/*
+ * Decodes through pread and pwrite instead of the mappings: up to
+ * async_slots windows are in flight, so while this thread decodes one the
+ * I/O threads read the next ones and write the previous ones, and it only
+ * waits when the window it needs next has not been read yet
+ */
+void decode_async(Context &context, const IByteStream &ibs,
+                  const std::string &encoded_pathname, bool parallel,
+                  Profile *profile) {
+    const std::vector<Member> &members = context.members_;
+    const std::string &pathname = context.pathname_;
+    Profile::Scope scope(profile, Stage::decode);
+    std::size_t blocks = block_count(members);
+    std::size_t block_size = 0;
+    std::size_t member_blocks = 0;  // of the largest member
+    for (const Member &member : members) {
+        block_size = std::max(block_size, member.header_.block_size);
+        member_blocks = std::max(member_blocks, member.header_.blocks());
+    }
+    std::size_t max_memory = context.options_.max_memory;
+    std::size_t window = window_blocks(
+        (max_memory != 0 ? max_memory : async_memory) / async_slots,
+        block_size, member_blocks);
+    window = std::min(window, (member_blocks + lanes - 1) / lanes * lanes);
+    std::size_t windows = 0;
+    std::size_t in_stride = 0;
+    for (const Member &member : members) {
+        const Header &header = member.header_;
+        for (std::size_t first = 0; first < header.blocks(); first += window) {
+            std::size_t last = std::min(first + window, header.blocks());
+            in_stride = std::max(in_stride,
+                                 header.end(last - 1) - header.begin(first));
+            ++windows;
+        }
+        ibs.release(member.offset_, member.offset_ + member.header_.size);
+    }
+    std::size_t slots = std::min(async_slots, windows);
+    std::size_t out_stride = window * block_size;
+
+    int in_fd = open(encoded_pathname.c_str(), O_RDONLY);
+    int out_fd = open(pathname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (in_fd == -1 || out_fd == -1 ||
+        ftruncate(out_fd, decoded_size(members)) == -1) {
+        println("Error: {}", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    context.staging_.resize(slots * (in_stride + out_stride));
+    IoQueue io(async_io_threads);
+    AsyncDecode decode{
+        .io_ = io,
+        .in_fd_ = in_fd,
+        .out_fd_ = out_fd,
+        .window_ = window,
+        .in_ = context.staging_.data(),
+        .in_stride_ = in_stride,
+        .out_ = context.staging_.data() + slots * in_stride,
+        .out_stride_ = out_stride,
+        .parallel_ = parallel,
+        .threads_ = team_size(context.options_),
+        .corrupt_ = blocks,  // none yet
+    };
+    std::array<Task, async_slots> tasks;
+    std::size_t member = 0;
+    std::size_t next = 0;  // first block of the member's next window
+    do {
+        for (std::size_t slot = 0; slot < slots; ++slot) {
+            while (tasks[slot].done() && decode.corrupt_ == blocks &&
+                   decode.error_ == 0) {
+                while (member < members.size() &&
+                       next >= members[member].header_.blocks()) {
+                    ++member;
+                    next = 0;
                 }
-            }
-            delete[] intervals;
-        } else {
-            std::size_t bits_used = header_bits;
-            for (std::size_t i = 0; i < ibs.size(); ++i) {
-                uint8_t value = ibs[i];
-                BitVector &code = codes[value];
-                code.copy(obs_map + bits_used / 8, bits_used % 8);
-                bits_used += code.size();
+                if (member == members.size()) {
+                    break;
+                }
+                tasks[slot] =
+                    decode_window(decode, slot, members[member], next);
+                next += window;
             }
         }
-        println("sloth: Compression ratio: {:.2f}",
-                ibs.size() / static_cast<double>(encoded_size));
+    } while (io.run_one());
+    close(in_fd);
+    close(out_fd);
+
+    if (decode.error_ != 0) {
+        std::filesystem::remove(pathname);
+        println("Error: {}", strerror(decode.error_));
+        exit(EXIT_FAILURE);
+    }
+    if (decode.corrupt_ != blocks) {
+        exit_corrupt(encoded_pathname, pathname, decode.corrupt_);
     }
 }
 
-void Parallel::Processor::decode(std::string encoded_pathname,
-                                 std::string decoded_pathname) {
-    IByteStream ibs(encoded_pathname);
-    const uint8_t *ibs_map = ibs.map();
-    size_t encoded_size = ibs.size();
-
-    std::size_t decoded_size = 0;
-    std::memcpy(&decoded_size, ibs_map, 8);
+void decode(Context &context, const IByteStream &ibs,
+            const std::string &encoded_pathname,
+            const std::string &decoded_pathname, bool parallel,
+            Profile *profile) {
+    Placement placement(context.options_, parallel);
+    {
+        Profile::Scope scope(profile, Stage::table);
+        std::string error = read_members(context, ibs);
+        if (!error.empty()) {
+            println("sloth: {} is corrupt: {}", encoded_pathname, error);
+            exit(EXIT_FAILURE);
+        }
+    }
+    const std::string &pathname =
+        context.pathname_.assign(decoded_pathname).append(".res");
+    std::size_t blocks = block_count(context.members_);
+    if (context.options_.async_io && blocks != 0) {
+        decode_async(context, ibs, encoded_pathname, parallel, profile);
+        return;
+    }
+    std::size_t corrupt;
+    {
+        OByteStream obs(pathname, decoded_size(context.members_));
+        corrupt = decode_mapped(context, ibs, obs, parallel, profile);
+    }
+    if (corrupt != blocks) {
+        exit_corrupt(encoded_pathname, pathname, corrupt);
+    }
+}
 
-    std::array<uint8_t, 256> code_lengths;
-    std::memcpy(code_lengths.data(), ibs_map + 8, 256);
+// the first corruption found, empty when none
+std::string decode(Context &context, std::span<const uint8_t> in,
+                   std::vector<uint8_t> &out, bool parallel,
+                   Profile *profile) {
+    Placement placement(context.options_, parallel);
+    IByteStream ibs(in.data(), in.size());
     {
-        std::pair<uint8_t, std::size_t> barriers[256] = {{0, 0}};
-        Symbols symbols;
-        symbols.initialize(
-            256 - std::count(code_lengths.begin(), code_lengths.end(), 0));
-        for (std::size_t i = 0, symbols_i = 0; i < 256; ++i) {
-            if (code_lengths[i] != 0) {
-                symbols[symbols_i++] = {
-                    .weight_ = 0,
-                    .value_ = static_cast<uint8_t>(i),
-                    .length_ = code_lengths[i],
-                };
-            }
+        Profile::Scope scope(profile, Stage::table);
+        std::string error = read_members(context, ibs);
+        if (!error.empty()) {
+            return error;
         }
-        BitVector *codes = symbols.generate_codes();
-        for (std::size_t i = 0; i < symbols.size() - 1; ++i) {
-            uint8_t value_a = symbols[i].value_;
-            BitVector &code_a = codes[value_a];
-            uint8_t barrier_a = static_cast<uint8_t>(code_a.value())
-                                << (8 - code_a.size());
+    }
+    std::size_t size = decoded_size(context.members_);
+    std::size_t max_size = context.options_.max_decoded_size;
+    if (max_size != 0 && size > max_size) {
+        return std::format("decoded size {} exceeds the limit of {}", size,
+                           max_size);
+    }
+    OByteStream obs(out, size);
+    std::size_t corrupt = decode_mapped(context, ibs, obs, parallel, profile);
+    if (corrupt != block_count(context.members_)) {
+        return std::format("checksum mismatch in block {}", corrupt);
+    }
+    return "";
+}
 
-            uint8_t value_b = symbols[i + 1].value_;
-            BitVector &code_b = codes[value_b];
-            uint8_t barrier_b = static_cast<uint8_t>(code_b.value())
-                                << (8 - code_b.size());
+Verification verify(Context &context, const IByteStream &ibs, bool parallel,
+                    Profile *profile) {
+    Placement placement(context.options_, parallel);
+    Verification verification;
+    {
+        Profile::Scope scope(profile, Stage::table);
+        verification.error = read_members(context, ibs);
+        if (!verification.error.empty()) {
+            return verification;
+        }
+        verification.blocks = block_count(context.members_);
+    }
 
-            for (std::size_t j = barrier_a; j < barrier_b; ++j) {
-                barriers[j] = {value_a, code_a.size()};
-            }
+    Profile::Scope scope(profile, Stage::decode);
+    std::size_t max_memory = context.options_.max_memory;
+    int threads = team_size(context.options_);
+    for (const Member &member : context.members_) {
+        const Header &header = member.header_;
+        std::size_t blocks = header.blocks();
+        if (blocks == 0) {
+            continue;
+        }
+        const DecodeTable &table = member.tables_->decode;
+        std::size_t body_offset = member.offset_ + header.size;
+        const uint8_t *body = ibs.map() + body_offset;
+        std::size_t window =
+            window_blocks(max_memory, header.block_size, blocks);
+        if (max_memory != 0) {
+            ibs.release(member.offset_, body_offset);
         }
+        std::size_t stride = lanes * header.block_size;
+        context.blocks_.resize((parallel ? threads : 1) * stride);
+#pragma omp parallel if (parallel) num_threads(threads)
         {
-            Symbol &symbol = symbols[symbols.size() - 1];
-            BitVector &code = codes[symbol.value_];
-            uint8_t barrier =
-                (static_cast<uint8_t>(code.value()) << (8 - code.size()));
-            for (std::size_t i = barrier; i < 256; ++i) {
-                barriers[i] = {symbol.value_, code.size()};
+            uint8_t *buffer =
+                context.blocks_.data() + omp_get_thread_num() * stride;
+            uint8_t *out[lanes];
+            for (std::size_t j = 0; j < lanes; ++j) {
+                out[j] = buffer + j * header.block_size;
             }
-        }
-        if (decoded_size > Sizes::page * 4) {
-            std::size_t intervals_size =
-                (decoded_size + Sizes::page - 1) / Sizes::page;
-            std::tuple<size_t, size_t> *intervals =
-                new std::tuple<size_t, size_t>[intervals_size];
-
-            {
-                std::size_t bits_read = header_bits;
-                for (std::size_t i = 0; i < decoded_size; i += Sizes::page) {
-                    intervals[i / Sizes::page] = {i, bits_read};
-                    for (std::size_t j = i;
-                         j < i + Sizes::page && j < decoded_size; ++j) {
-                        std::size_t bytes_read = bits_read / 8;
-
-                        uint8_t byte_1 = ibs[bytes_read];
-                        uint8_t byte_2 =
-                            ibs[bytes_read + (bytes_read - 1 < encoded_size)];
-
-                        std::size_t bit_offset = bits_read % 8;
-                        byte_1 <<= bit_offset;
-                        byte_2 >>= (8 - bit_offset);
-                        uint8_t byte = byte_1 | byte_2;
-
-                        std::pair<uint8_t, std::size_t> barrier =
-                            barriers[byte];
-                        bits_read += barrier.second;
+            for (std::size_t first = 0; first < blocks; first += window) {
+                std::size_t last = std::min(first + window, blocks);
+#pragma omp for schedule(runtime)
+                for (std::size_t i = first; i < last; i += lanes) {
+                    std::size_t count = std::min(lanes, last - i);
+                    decode_group(header, body, 0, header.offsets.back(), table,
+                                 i, count, out);
+                    for (std::size_t j = 0; j < count; ++j) {
+                        std::size_t block = i + j;
+                        if (xxhash64(out[j],
+                                     header.decoded_end(block) -
+                                         header.decoded_begin(block)) !=
+                            header.checksums[block]) {
+#pragma omp critical
+                            verification.corrupt.push_back(
+                                member.first_block_ + block);
+                        }
                     }
                 }
+                if (max_memory != 0) {
+#pragma omp single
+                    ibs.release(body_offset + header.begin(first),
+                                body_offset + header.end(last - 1));
+                }
             }
+        }
+    }
+    std::sort(verification.corrupt.begin(), verification.corrupt.end());
+    return verification;
+}
 
-            OByteStream obs(decoded_pathname + ".res", decoded_size);
-            uint8_t *obs_map = obs.map();
-
-#pragma omp parallel for schedule(static)
-            for (std::size_t i = 0; i < intervals_size; ++i) {
-                std::tuple<size_t, size_t> &interval = intervals[i];
-                std::size_t obs_i = std::get<0>(interval);
-                std::size_t bits_read = std::get<1>(interval);
-                for (std::size_t j = obs_i;
-                     j < obs_i + Sizes::page && j < ibs.size(); ++j) {
-                    std::size_t byte_offset = bits_read / 8;
-                    uint8_t byte_1 = ibs[byte_offset];
-                    uint8_t byte_2 = 0;
-                    if (byte_offset - 1 < encoded_size) {
-                        byte_2 = ibs[byte_offset + 1];
-                    }
+/*
+ * Reads only the headers of the encoded file, to find how much of the input
+ * it already holds, and the input past that
+ */
+std::size_t append(Context &context, const std::string &pathname,
+                   const std::string &encoded_pathname, bool parallel,
+                   Profile *profile) {
+    std::size_t encoded;
+    {
+        IByteStream encoded_ibs(encoded_pathname);
+        std::string error = read_members(context, encoded_ibs);
+        if (!error.empty()) {
+            println("sloth: {} is corrupt: {}", encoded_pathname, error);
+            exit(EXIT_FAILURE);
+        }
+        encoded = decoded_size(context.members_);
+    }
+    IByteStream ibs(pathname);
+    if (ibs.size() < encoded) {
+        println("sloth: {} is shorter than what {} holds", pathname,
+                encoded_pathname);
+        exit(EXIT_FAILURE);
+    }
+    if (ibs.size() == encoded) {
+        return 0;
+    }
+    std::size_t end = std::filesystem::file_size(encoded_pathname);
+    return encode_members(
+        context, ibs, encoded,
+        [&](std::size_t size, std::size_t at) {
+            return OByteStream(encoded_pathname, size, end + at);
+        },
+        parallel, profile);
+}
 
-                    std::size_t bit_offset = bits_read % 8;
-                    byte_1 <<= bit_offset;
-                    byte_2 >>= (8 - bit_offset);
-                    uint8_t byte = byte_1 | byte_2;
+}  // namespace
 
-                    std::pair<uint8_t, std::size_t> barrier = barriers[byte];
-                    std::memcpy(obs_map + j, &(barrier.first), 1);
-                    bits_read += barrier.second;
-                }
-            }
-            delete[] intervals;
-        } else {
-            OByteStream obs(decoded_pathname + ".res", decoded_size);
-            uint8_t *obs_map = obs.map();
-
-            std::size_t bits_read = header_bits;
-            for (size_t i = 0; i < decoded_size; ++i) {
-                std::size_t byte_offset = bits_read / 8;
-                uint8_t byte_1 = ibs[byte_offset];
-                uint8_t byte_2 = 0;
-                if (byte_offset - 1 < encoded_size) {
-                    byte_2 = ibs[byte_offset + 1];
-                }
+bool Verification::ok() const { return error.empty() && corrupt.empty(); }
+
+/**
+ * Decoder
+ */
+
+Decoder::Decoder(const std::string &encoded_pathname)
+    : ibs_(encoded_pathname) {
+    error_ = read_members(context_, ibs_);
+}
 
-                std::size_t bit_offset = bits_read % 8;
-                byte_1 <<= bit_offset;
-                byte_2 >>= (8 - bit_offset);
-                uint8_t byte = byte_1 | byte_2;
+const std::string &Decoder::error() const { return error_; }
 
-                std::pair<uint8_t, std::size_t> barrier = barriers[byte];
-                std::memcpy(obs_map + i, &(barrier.first), 1);
-                bits_read += barrier.second;
+std::size_t Decoder::size() const {
+    return context_.members_.empty() ? 0 : decoded_size(context_.members_);
+}
+
+/*
+ * The cursor is loaded into locals for the loop and stored back once, so
+ * it stays in registers across the blocks of a call
+ */
+std::span<uint8_t> Decoder::read(std::span<uint8_t> out) {
+    const std::vector<Member> &members = context_.members_;
+    std::size_t member = member_;
+    std::size_t block = block_;
+    std::size_t bits_read = bits_read_;
+    std::size_t decoded = decoded_;
+    std::size_t filled = 0;
+    while (filled < out.size() && member < members.size() && error_.empty()) {
+        const Header &header = members[member].header_;
+        if (block == header.blocks()) {
+            ++member;
+            block = 0;
+            continue;
+        }
+        const uint8_t *body =
+            ibs_.map() + members[member].offset_ + header.size;
+        std::size_t block_size =
+            header.decoded_end(block) - header.decoded_begin(block);
+        std::size_t count = std::min(out.size() - filled, block_size - decoded);
+        bits_read = decode_block(members[member].tables_->decode,
+                                 body + header.begin(block),
+                                 header.end(block) - header.begin(block),
+                                 out.data() + filled, count, bits_read);
+        hash_.update(out.data() + filled, count);
+        filled += count;
+        decoded += count;
+        if (decoded == block_size) {
+            if (hash_.digest() != header.checksums[block]) {
+                error_ = std::format("checksum mismatch in block {}",
+                                     members[member].first_block_ + block);
             }
+            hash_.reset();
+            ++block;
+            bits_read = 0;
+            decoded = 0;
         }
     }
+    member_ = member;
+    block_ = block;
+    bits_read_ = bits_read;
+    decoded_ = decoded;
+    return out.first(filled);
+}
+
+std::ranges::subrange<Decoder::Iterator, std::default_sentinel_t>
+Decoder::batches(std::size_t size) {
+    batch_.resize(size);
+    return {Iterator(*this), std::default_sentinel};
+}
+
+Decoder::Iterator::Iterator(Decoder &decoder) : decoder_(&decoder) {
+    ++*this;
+}
+
+const std::span<const uint8_t> &Decoder::Iterator::operator*() const {
+    return batch_;
+}
+
+Decoder::Iterator &Decoder::Iterator::operator++() {
+    batch_ = decoder_->read(decoder_->batch_);
+    return *this;
+}
+
+void Decoder::Iterator::operator++(int) { ++*this; }
+
+bool Decoder::Iterator::operator==(std::default_sentinel_t) const {
+    return batch_.empty();
+}
+
+static_assert(std::input_iterator<Decoder::Iterator>);
+static_assert(std::movable<Decoder> && !std::copyable<Decoder>);
+
+Estimate Serial::Processor::estimate(const std::string &pathname,
+                                     double fraction, Profile *profile) {
+    Context context;
+    return estimate(context, pathname, fraction, profile);
+}
+
+Estimate Serial::Processor::estimate(Context &context,
+                                     const std::string &pathname,
+                                     double fraction, Profile *profile) {
+    IByteStream ibs(pathname);
+    return HuffmanCoding::estimate(context, ibs, fraction, false, profile);
+}
+
+std::size_t Serial::Processor::encode(const std::string &pathname,
+                                      const std::string &encoded_pathname,
+                                      Profile *profile) {
+    Context context;
+    return encode(context, pathname, encoded_pathname, profile);
+}
+
+std::size_t Serial::Processor::encode(Context &context,
+                                      const std::string &pathname,
+                                      const std::string &encoded_pathname,
+                                      Profile *profile) {
+    IByteStream ibs(pathname);
+    return encode_members(
+        context, ibs, 0,
+        [&](std::size_t size, std::size_t at) {
+            return at == 0 ? OByteStream(encoded_pathname, size)
+                           : OByteStream(encoded_pathname, size, at);
+        },
+        false, profile);
+}
+
+std::size_t Serial::Processor::append(const std::string &pathname,
+                                       const std::string &encoded_pathname,
+                                       Profile *profile) {
+    Context context;
+    return append(context, pathname, encoded_pathname, profile);
+}
+
+std::size_t Serial::Processor::append(Context &context,
+                                       const std::string &pathname,
+                                       const std::string &encoded_pathname,
+                                       Profile *profile) {
+    return HuffmanCoding::append(context, pathname, encoded_pathname, false,
+                                 profile);
+}
+
+void Serial::Processor::decode(const std::string &encoded_pathname,
+                               const std::string &decoded_pathname,
+                               Profile *profile) {
+    Context context;
+    decode(context, encoded_pathname, decoded_pathname, profile);
+}
+
+void Serial::Processor::decode(Context &context,
+                               const std::string &encoded_pathname,
+                               const std::string &decoded_pathname,
+                               Profile *profile) {
+    IByteStream ibs(encoded_pathname);
+    HuffmanCoding::decode(context, ibs, encoded_pathname, decoded_pathname,
+                          false, profile);
+}
+
+std::size_t Serial::Processor::encode(Context &context,
+                                       std::span<const uint8_t> in,
+                                       std::vector<uint8_t> &out,
+                                       Profile *profile) {
+    IByteStream ibs(in.data(), in.size());
+    return encode_members(
+        context, ibs, 0,
+        [&](std::size_t size, std::size_t at) {
+            return OByteStream(out, size, at);
+        },
+        false, profile);
+}
+
+std::string Serial::Processor::decode(Context &context,
+                                       std::span<const uint8_t> in,
+                                       std::vector<uint8_t> &out,
+                                       Profile *profile) {
+    return HuffmanCoding::decode(context, in, out, false, profile);
+}
+
+Verification Serial::Processor::verify(const std::string &encoded_pathname,
+                                       Profile *profile) {
+    Context context;
+    return verify(context, encoded_pathname, profile);
+}
+
+Verification Serial::Processor::verify(Context &context,
+                                       const std::string &encoded_pathname,
+                                       Profile *profile) {
+    IByteStream ibs(encoded_pathname);
+    return HuffmanCoding::verify(context, ibs, false, profile);
+}
+
+Estimate Parallel::Processor::estimate(const std::string &pathname,
+                                       double fraction, Profile *profile) {
+    Context context;
+    return estimate(context, pathname, fraction, profile);
+}
+
+Estimate Parallel::Processor::estimate(Context &context,
+                                       const std::string &pathname,
+                                       double fraction, Profile *profile) {
+    IByteStream ibs(pathname);
+    return HuffmanCoding::estimate(context, ibs, fraction, true, profile);
+}
+
+std::size_t Parallel::Processor::encode(const std::string &pathname,
+                                        const std::string &encoded_pathname,
+                                        Profile *profile) {
+    Context context;
+    return encode(context, pathname, encoded_pathname, profile);
+}
+
+std::size_t Parallel::Processor::encode(Context &context,
+                                        const std::string &pathname,
+                                        const std::string &encoded_pathname,
+                                        Profile *profile) {
+    IByteStream ibs(pathname);
+    return encode_members(
+        context, ibs, 0,
+        [&](std::size_t size, std::size_t at) {
+            return at == 0 ? OByteStream(encoded_pathname, size)
+                           : OByteStream(encoded_pathname, size, at);
+        },
+        true, profile);
+}
+
+std::size_t Parallel::Processor::append(const std::string &pathname,
+                                         const std::string &encoded_pathname,
+                                         Profile *profile) {
+    Context context;
+    return append(context, pathname, encoded_pathname, profile);
+}
+
+std::size_t Parallel::Processor::append(Context &context,
+                                         const std::string &pathname,
+                                         const std::string &encoded_pathname,
+                                         Profile *profile) {
+    return HuffmanCoding::append(context, pathname, encoded_pathname, true,
+                                 profile);
+}
+
+void Parallel::Processor::decode(const std::string &encoded_pathname,
+                                 const std::string &decoded_pathname,
+                                 Profile *profile) {
+    Context context;
+    decode(context, encoded_pathname, decoded_pathname, profile);
+}
+
+void Parallel::Processor::decode(Context &context,
+                                 const std::string &encoded_pathname,
+                                 const std::string &decoded_pathname,
+                                 Profile *profile) {
+    IByteStream ibs(encoded_pathname);
+    HuffmanCoding::decode(context, ibs, encoded_pathname, decoded_pathname,
+                          true, profile);
+}
+
+std::size_t Parallel::Processor::encode(Context &context,
+                                         std::span<const uint8_t> in,
+                                         std::vector<uint8_t> &out,
+                                         Profile *profile) {
+    IByteStream ibs(in.data(), in.size());
+    return encode_members(
+        context, ibs, 0,
+        [&](std::size_t size, std::size_t at) {
+            return OByteStream(out, size, at);
+        },
+        true, profile);
+}
+
+std::string Parallel::Processor::decode(Context &context,
+                                         std::span<const uint8_t> in,
+                                         std::vector<uint8_t> &out,
+                                         Profile *profile) {
+    return HuffmanCoding::decode(context, in, out, true, profile);
+}
+
+Verification Parallel::Processor::verify(const std::string &encoded_pathname,
+                                         Profile *profile) {
+    Context context;
+    return verify(context, encoded_pathname, profile);
+}
+
+Verification Parallel::Processor::verify(Context &context,
+                                         const std::string &encoded_pathname,
+                                         Profile *profile) {
+    IByteStream ibs(encoded_pathname);
+    return HuffmanCoding::verify(context, ibs, true, profile);
 }
 
 }  // namespace HuffmanCoding
@@ -1,13 +1,25 @@
 #ifndef HUFFMAN_CODING_HPP
 #define HUFFMAN_CODING_HPP
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <span>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
+#include "format.hpp"
+#include "kernels.hpp"
+#include "table_cache.hpp"
+#include "utils/bench.hpp"
 #include "utils/bit_vector.hpp"
+#include "utils/byte_stream.hpp"
+#include "utils/hash.hpp"
 
 namespace HuffmanCoding {
 
@@ -18,45 +30,323 @@ struct Symbol {
 };
 
 class Symbols {
+    // a leaf or a package of two items of the previous level
     struct PackageMergeItem {
-        std::vector<Symbol *> symbols_;
-        std::size_t weight_;
-
-        PackageMergeItem();
-        PackageMergeItem(Symbol *symbol);
-        bool operator<(const PackageMergeItem &rhs) const;
-        PackageMergeItem operator+(const PackageMergeItem &rhs) const;
+        uint64_t weight_;
+        int16_t symbol_;  // -1 for a package
     };
 
-    Symbol *symbols_;
-    std::size_t size_;
+    std::array<Symbol, 256> symbols_;
+    std::size_t size_ = 0;
+    // every level of package-merge, kept across runs so they reuse it
+    std::vector<PackageMergeItem> items_;
 
    public:
-    Symbols();
-    ~Symbols();
     Symbol *data();
     Symbol &operator[](std::size_t index);
     void initialize(std::size_t size);
+    // one symbol per nonzero count, weighted by it
+    void initialize(const std::array<std::size_t, 256> &counts);
     std::size_t size() const;
-    void fill_lengths();
-    BitVector *generate_codes();
+    // optimal lengths of at most max_length bits
+    void fill_lengths(std::size_t max_length);
+    // faster, with lengths of at most max_length that are optimal unless
+    // they had to be limited
+    void fill_lengths_heuristic(std::size_t max_length);
+    std::size_t encoded_bits() const;  // body size once lengths are filled
+    void generate_codes(std::array<BitVector, 256> &codes);
+};
+
+constexpr std::size_t block_size = 1 << 18;  // decoded bytes per block
+
+enum class Stage : std::size_t {
+    histogram,
+    lengths,
+    codes,
+    emit,
+    table,
+    decode
+};
+constexpr std::size_t stages = 6;
+constexpr std::array<std::string_view, stages> stage_names = {
+    "histogram", "lengths", "codes", "emit", "table", "decode"};
+
+/**
+ * Wall-clock seconds, and optionally per-thread event counts, spent in each
+ * stage of one encode or decode
+ */
+class Profile {
+    std::array<double, stages> seconds_ = {0};
+    Counters *counters_;
+    std::array<std::vector<Counters::Values>, stages> counts_;
+
+   public:
+    class Scope {
+        Profile *profile_;
+        Stage stage_;
+        std::vector<Counters::Values> start_;
+        Bench bench_;
+
+       public:
+        Scope(Profile *profile, Stage stage);
+        ~Scope();
+    };
+
+    Profile(Counters *counters = nullptr);
+    double operator[](Stage stage) const;
+    // per thread; empty without counters or when the stage never ran
+    const std::vector<Counters::Values> &counts(Stage stage) const;
+};
+
+/**
+ * Predicted output of encode, from the histogram and code lengths alone
+ */
+struct Estimate {
+    std::size_t size;          // bytes in the input
+    std::size_t sampled;       // bytes of the input actually read
+    std::size_t encoded_size;  // predicted bytes of the encoded file
+};
+
+// spans of this many bytes are read when sampling
+constexpr std::size_t sample_span = 1 << 20;
+
+/*
+ * Effort encode spends on the code, trading speed for ratio
+ *   1: lengths from a quarter of the input, built heuristically, for small
+ *      payloads where building the code dominates
+ *   2: optimal lengths for every byte, by package-merge
+ *   3: as 2, and the input is split into members wherever a code of their
+ *      own saves more than their header costs, for archives
+ * Codes are at most code_length_limit bits at every level, so decode
+ * tables stay small.
+ */
+constexpr int min_level = 1;
+constexpr int default_level = 2;
+constexpr int max_level = 3;
+constexpr std::size_t code_length_limit = 12;
+
+/**
+ * How encode, decode and verify may use the machine
+ */
+struct Options {
+    // bytes of input and output resident at once, 0 for no limit. Files
+    // are then processed in windows of whole blocks, at least lanes of
+    // them, and each window is dropped from memory once done
+    std::size_t max_memory = 0;
+    // of the parallel processors, 0 for the OpenMP default
+    int threads = 0;
+    // one CPU per thread, filling a NUMA node before the next
+    bool pin = false;
+    // every pass gives each thread the same contiguous range of blocks, so
+    // a pinned thread reads and first-touches pages on its own node,
+    // instead of taking blocks dynamically
+    bool numa_local = false;
+    // decode reads the encoded blocks and writes the decoded ones with
+    // pread and pwrite on I/O threads, a few windows ahead of and behind
+    // the one being decoded, instead of faulting both mappings in
+    bool async_io = false;
+    // bit order of the members encode writes, decode follows each member's
+    Layout layout = Layout::msb_first;
+    int level = default_level;  // of encode
+    // bytes an in-memory decode may produce, past which it fails without
+    // allocating them, 0 for no limit
+    std::size_t max_decoded_size = 0;
+};
+
+/**
+ * A member of an encoded file, with its place among the others
+ */
+struct Member {
+    Header header_;
+    std::shared_ptr<const Tables> tables_;  // none without blocks
+    std::size_t offset_ = 0;          // of the header in the file
+    std::size_t decoded_offset_ = 0;  // of its first decoded byte
+    std::size_t first_block_ = 0;     // numbering blocks across the file
+};
+
+/**
+ * Options, plus scratch space for encode, decode and verify: histogram,
+ * package-merge levels, code and decode tables, header and buffers. Passing
+ * the same one to every call means none of them allocates once it has grown
+ * to fit the largest input. Not shared between concurrent calls.
+ */
+struct Context {
+    Options options_;
+    std::array<std::size_t, 256> counts_;
+    Symbols symbols_;
+    std::array<BitVector, 256> codes_;
+    std::shared_ptr<const Tables> tables_;  // shared with TableCache
+    Header header_;                // of the member encode writes
+    std::vector<Member> members_;  // of the file decode reads
+    std::vector<uint8_t> serialized_;
+    std::vector<uint8_t> blocks_;  // decoded blocks, lanes per thread
+    std::vector<uint8_t> staging_;  // windows in flight of async decode
+    // per segment of the input, and where the members of level 3 start
+    std::vector<std::array<std::size_t, 256>> segment_counts_;
+    std::vector<std::size_t> runs_;
+    std::string pathname_;
+};
+
+/**
+ * Result of checking every block of an encoded file against its checksum
+ */
+struct Verification {
+    std::string error;  // unreadable header, empty otherwise
+    std::size_t blocks = 0;
+    std::vector<std::size_t> corrupt;  // blocks whose checksum mismatches
+
+    bool ok() const;
 };
 
-constexpr std::size_t header_bits = (8 + 256) * 8;
+/**
+ * Pulls the decoded bytes of an encoded file in batches of the caller's
+ * size, with no output file in between. The blocks are decoded in order,
+ * each read call resuming the block and bit the previous one stopped at.
+ * Checksums are checked as blocks end, so the bytes of a corrupt block are
+ * returned before the error is.
+ */
+class Decoder {
+    IByteStream ibs_;
+    Context context_;
+    std::string error_;
+    std::size_t member_ = 0;     // being decoded
+    std::size_t block_ = 0;      // being decoded, within the member
+    std::size_t bits_read_ = 0;  // of its encoded bytes
+    std::size_t decoded_ = 0;    // of its decoded bytes
+    XxHash64 hash_;              // of its decoded bytes
+    std::vector<uint8_t> batch_;
+
+   public:
+    class Iterator {
+        Decoder *decoder_ = nullptr;
+        std::span<const uint8_t> batch_;
+
+       public:
+        using value_type = std::span<const uint8_t>;
+        using difference_type = std::ptrdiff_t;
+
+        Iterator() = default;
+        // reads the first batch
+        explicit Iterator(Decoder &decoder);
+        const std::span<const uint8_t> &operator*() const;
+        Iterator &operator++();
+        void operator++(int);
+        bool operator==(std::default_sentinel_t) const;
+    };
+
+    explicit Decoder(const std::string &encoded_pathname);
+    // the unreadable header or first corrupt block, empty while there is none
+    const std::string &error() const;
+    // decoded bytes in all
+    std::size_t size() const;
+    // fills a prefix of out, all of it until the last bytes. Returns the
+    // prefix, empty once every byte was returned or after an error
+    std::span<uint8_t> read(std::span<uint8_t> out);
+    // the remaining bytes as an input range of batches of size bytes, each
+    // valid until the iterator is incremented
+    std::ranges::subrange<Iterator, std::default_sentinel_t> batches(
+        std::size_t size);
+};
 
 namespace Serial {
 class Processor {
    public:
-    static void encode(std::string pathname, std::string encoded_pathname);
-    static void decode(std::string encoded_pathname, std::string pathname);
+    // reads roughly fraction of the input, in evenly spaced spans, and at
+    // least one span. With the whole input read, the encoded size is an
+    // upper bound by at most one byte per block on what encode writes with
+    // the same options
+    static Estimate estimate(const std::string &pathname, double fraction = 1,
+                             Profile *profile = nullptr);
+    static Estimate estimate(Context &context, const std::string &pathname,
+                             double fraction = 1, Profile *profile = nullptr);
+    // returns the encoded size in bytes
+    static std::size_t encode(const std::string &pathname,
+                              const std::string &encoded_pathname,
+                              Profile *profile = nullptr);
+    static std::size_t encode(Context &context, const std::string &pathname,
+                              const std::string &encoded_pathname,
+                              Profile *profile = nullptr);
+    // encodes the bytes of pathname past the ones encoded_pathname decodes
+    // to as a new member, and returns the bytes appended. pathname is
+    // expected to have only grown since it was encoded
+    static std::size_t append(const std::string &pathname,
+                              const std::string &encoded_pathname,
+                              Profile *profile = nullptr);
+    static std::size_t append(Context &context, const std::string &pathname,
+                              const std::string &encoded_pathname,
+                              Profile *profile = nullptr);
+    // exits on a corrupt header or block
+    static void decode(const std::string &encoded_pathname,
+                       const std::string &pathname,
+                       Profile *profile = nullptr);
+    static void decode(Context &context, const std::string &encoded_pathname,
+                       const std::string &pathname,
+                       Profile *profile = nullptr);
+    // in memory, replacing the contents of out. Decode returns the first
+    // corruption found instead of exiting, empty when there is none
+    static std::size_t encode(Context &context, std::span<const uint8_t> in,
+                              std::vector<uint8_t> &out,
+                              Profile *profile = nullptr);
+    static std::string decode(Context &context, std::span<const uint8_t> in,
+                              std::vector<uint8_t> &out,
+                              Profile *profile = nullptr);
+    // decodes every block without writing the output
+    static Verification verify(const std::string &encoded_pathname,
+                               Profile *profile = nullptr);
+    static Verification verify(Context &context,
+                               const std::string &encoded_pathname,
+                               Profile *profile = nullptr);
 };
 }  // namespace Serial
 
 namespace Parallel {
 class Processor {
    public:
-    static void encode(std::string pathname, std::string encoded_pathname);
-    static void decode(std::string encoded_pathname, std::string pathname);
+    // reads roughly fraction of the input, in evenly spaced spans, and at
+    // least one span. With the whole input read, the encoded size is an
+    // upper bound by at most one byte per block on what encode writes with
+    // the same options
+    static Estimate estimate(const std::string &pathname, double fraction = 1,
+                             Profile *profile = nullptr);
+    static Estimate estimate(Context &context, const std::string &pathname,
+                             double fraction = 1, Profile *profile = nullptr);
+    // returns the encoded size in bytes
+    static std::size_t encode(const std::string &pathname,
+                              const std::string &encoded_pathname,
+                              Profile *profile = nullptr);
+    static std::size_t encode(Context &context, const std::string &pathname,
+                              const std::string &encoded_pathname,
+                              Profile *profile = nullptr);
+    // encodes the bytes of pathname past the ones encoded_pathname decodes
+    // to as a new member, and returns the bytes appended. pathname is
+    // expected to have only grown since it was encoded
+    static std::size_t append(const std::string &pathname,
+                              const std::string &encoded_pathname,
+                              Profile *profile = nullptr);
+    static std::size_t append(Context &context, const std::string &pathname,
+                              const std::string &encoded_pathname,
+                              Profile *profile = nullptr);
+    // exits on a corrupt header or block
+    static void decode(const std::string &encoded_pathname,
+                       const std::string &pathname,
+                       Profile *profile = nullptr);
+    static void decode(Context &context, const std::string &encoded_pathname,
+                       const std::string &pathname,
+                       Profile *profile = nullptr);
+    // in memory, replacing the contents of out. Decode returns the first
+    // corruption found instead of exiting, empty when there is none
+    static std::size_t encode(Context &context, std::span<const uint8_t> in,
+                              std::vector<uint8_t> &out,
+                              Profile *profile = nullptr);
+    static std::string decode(Context &context, std::span<const uint8_t> in,
+                              std::vector<uint8_t> &out,
+                              Profile *profile = nullptr);
+    // decodes every block without writing the output
+    static Verification verify(const std::string &encoded_pathname,
+                               Profile *profile = nullptr);
+    static Verification verify(Context &context,
+                               const std::string &encoded_pathname,
+                               Profile *profile = nullptr);
 };
 }  // namespace Parallel
 }  // namespace HuffmanCoding
@@ -0,0 +1,351 @@
+#include "kernels.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include <cstring>
+#include <type_traits>
+
+namespace HuffmanCoding {
+
+namespace {
+
+Kernel detect() {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) {
+        return Kernel::avx2;
+    }
+#endif
+    return Kernel::scalar;
+}
+
+Kernel &selected() {
+    static Kernel kernel = detect();
+    return kernel;
+}
+
+}  // namespace
+
+std::optional<Kernel> parse_kernel(std::string_view name) {
+    for (std::size_t i = 0; i < kernels; ++i) {
+        if (kernel_names[i] == name) {
+            return static_cast<Kernel>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+bool supported(Kernel kernel) {
+    return kernel == Kernel::scalar || kernel == detect();
+}
+
+Kernel kernel() { return selected(); }
+
+void set_kernel(Kernel kernel) { selected() = kernel; }
+
+std::optional<Layout> parse_layout(std::string_view name) {
+    for (std::size_t i = 0; i < layouts; ++i) {
+        if (layout_names[i] == name) {
+            return static_cast<Layout>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+std::size_t width(std::size_t max_length) {
+    for (std::size_t width : widths) {
+        if (max_length <= width) {
+            return width;
+        }
+    }
+    return 0;
+}
+
+namespace {
+
+// calls f with the table width as a compile-time constant
+template <typename F>
+auto dispatch(std::size_t width, F &&f) {
+    switch (width) {
+        case 8:
+            return f(std::integral_constant<std::size_t, 8>{});
+        case 12:
+            return f(std::integral_constant<std::size_t, 12>{});
+        default:
+            return f(std::integral_constant<std::size_t, 16>{});
+    }
+}
+
+/*
+ * Codes collect in a 64-bit buffer holding fewer than 32 pending bits, so
+ * 32 / Width codes always fit before the next 4-byte flush
+ */
+template <std::size_t Width>
+std::size_t encode_msb(const uint32_t codes[256], const uint8_t *in,
+                       std::size_t size, uint8_t *out) {
+    constexpr std::size_t per_flush = 32 / Width;
+    uint8_t *begin = out;
+    uint64_t buffer = 0;
+    std::size_t pending = 0;
+    auto put = [&](uint8_t value) {
+        uint32_t code = codes[value];
+        buffer = buffer << (code & 0xff) | code >> 8;
+        pending += code & 0xff;
+    };
+    auto flush = [&] {
+        if (pending >= 32) {
+            pending -= 32;
+            uint32_t word = __builtin_bswap32(buffer >> pending);
+            std::memcpy(out, &word, 4);
+            out += 4;
+        }
+    };
+
+    std::size_t i = 0;
+    for (; i + per_flush <= size; i += per_flush) {
+        for (std::size_t j = 0; j < per_flush; ++j) {
+            put(in[i + j]);
+        }
+        flush();
+    }
+    for (; i < size; ++i) {
+        put(in[i]);
+        flush();
+    }
+    for (; pending >= 8; pending -= 8) {
+        *out++ = buffer >> (pending - 8);
+    }
+    if (pending != 0) {
+        *out++ = buffer << (8 - pending);
+    }
+    return out - begin;
+}
+
+/*
+ * Codes are ORed in above the pending bits, fewer than 8 after every flush,
+ * so 56 / Width codes fit before the next. A flush stores all 8 bytes of
+ * the buffer and advances by the whole ones, which never writes past the
+ * block's padding.
+ */
+template <std::size_t Width>
+std::size_t encode_lsb(const uint32_t codes[256], const uint8_t *in,
+                       std::size_t size, uint8_t *out) {
+    constexpr std::size_t per_flush = 56 / Width;
+    uint8_t *begin = out;
+    uint64_t buffer = 0;
+    std::size_t pending = 0;
+    auto put = [&](uint8_t value) {
+        uint32_t code = codes[value];
+        buffer |= static_cast<uint64_t>(code >> 8) << pending;
+        pending += code & 0xff;
+    };
+    auto flush = [&] {
+        std::memcpy(out, &buffer, 8);
+        out += pending / 8;
+        buffer >>= pending & ~7;
+        pending %= 8;
+    };
+
+    std::size_t i = 0;
+    for (; i + per_flush <= size; i += per_flush) {
+        for (std::size_t j = 0; j < per_flush; ++j) {
+            put(in[i + j]);
+        }
+        flush();
+    }
+    for (; i < size; ++i) {
+        put(in[i]);
+    }
+    flush();
+    if (pending != 0) {
+        ++out;
+    }
+    std::memset(out, 0, lsb_padding);
+    return out + lsb_padding - begin;
+}
+
+/*
+ * While 8 bytes remain, one big-endian load shifted to the cursor holds at
+ * least 57 bits, enough for 57 / Width codes without a refill. The tail of
+ * the block reads byte by byte with bounds checks.
+ */
+template <std::size_t Width>
+std::size_t decode_msb(const uint16_t *table, const uint8_t *in,
+                       std::size_t in_size, uint8_t *out, std::size_t out_size,
+                       std::size_t bits_read) {
+    constexpr std::size_t per_load = 57 / Width;
+    constexpr std::size_t tail_bytes = (Width + 14) / 8;
+    std::size_t i = 0;
+    while (out_size - i >= per_load && bits_read / 8 + 8 <= in_size) {
+        uint64_t window;
+        std::memcpy(&window, in + bits_read / 8, 8);
+        window = __builtin_bswap64(window) << (bits_read % 8);
+        for (std::size_t j = 0; j < per_load; ++j) {
+            uint16_t entry = table[window >> (64 - Width)];
+            out[i++] = entry;
+            window <<= entry >> 8;
+            bits_read += entry >> 8;
+        }
+    }
+    for (; i < out_size; ++i) {
+        std::size_t byte_offset = bits_read / 8;
+        uint32_t window = 0;
+        for (std::size_t j = 0; j < tail_bytes; ++j) {
+            window <<= 8;
+            if (byte_offset + j < in_size) {
+                window |= in[byte_offset + j];
+            }
+        }
+        std::size_t shift = tail_bytes * 8 - bits_read % 8 - Width;
+        uint16_t entry = table[(window >> shift) & ((1 << Width) - 1)];
+        out[i] = entry;
+        bits_read += entry >> 8;
+    }
+    return bits_read;
+}
+
+/*
+ * One little-endian load shifted right to the cursor holds at least 57
+ * bits, enough for 57 / Width codes, each looked up by its low Width bits.
+ * The padding keeps that load inside the block for every code of a valid
+ * one, so the final codes take a last, shorter round of the same loop
+ * instead of a checked tail.
+ */
+template <std::size_t Width>
+std::size_t decode_lsb(const uint16_t *table, const uint8_t *in,
+                       std::size_t in_size, uint8_t *out, std::size_t out_size,
+                       std::size_t bits_read) {
+    constexpr std::size_t per_load = 57 / Width;
+    constexpr uint64_t mask = (1 << Width) - 1;
+    auto load = [&](std::size_t count) {
+        uint64_t window;
+        std::memcpy(&window, in + bits_read / 8, 8);
+        window >>= bits_read % 8;
+        for (std::size_t j = 0; j < count; ++j) {
+            uint16_t entry = table[window & mask];
+            *out++ = entry;
+            window >>= entry >> 8;
+            bits_read += entry >> 8;
+        }
+    };
+    uint8_t *end = out + out_size;
+    while (end - out >= static_cast<std::ptrdiff_t>(per_load) &&
+           bits_read / 8 + 8 <= in_size) {
+        load(per_load);
+    }
+    if (out != end && bits_read / 8 + 8 <= in_size) {
+        load(end - out);
+    }
+    std::memset(out, 0, end - out);
+    return bits_read;
+}
+
+}  // namespace
+
+std::size_t encode_block(const EncodeTable &table, const uint8_t *in,
+                         std::size_t size, uint8_t *out) {
+    return dispatch(table.width, [&](auto width) {
+        return table.layout == Layout::lsb_first
+                   ? encode_lsb<width>(table.codes.data(), in, size, out)
+                   : encode_msb<width>(table.codes.data(), in, size, out);
+    });
+}
+
+std::size_t decode_block(const DecodeTable &table, const uint8_t *in,
+                         std::size_t in_size, uint8_t *out,
+                         std::size_t out_size, std::size_t bits_read) {
+    return dispatch(table.width, [&](auto width) {
+        return table.layout == Layout::lsb_first
+                   ? decode_lsb<width>(table.entries.data(), in, in_size, out,
+                                       out_size, bits_read)
+                   : decode_msb<width>(table.entries.data(), in, in_size, out,
+                                       out_size, bits_read);
+    });
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+namespace {
+
+/*
+ * Per lane: gather the 4 bytes holding the cursor and look its next Width
+ * bits up in a second gather. MSB-first byte swaps them and shifts the
+ * cursor's bit to the top, LSB-first shifts it to the bottom and masks. 4
+ * rounds fill one 32-bit word of output per lane before it is stored.
+ */
+template <std::size_t Width, Layout Order>
+__attribute__((target("avx2"))) void decode_lanes(const uint16_t *table,
+                                                  const uint8_t *base,
+                                                  uint32_t bits[lanes],
+                                                  uint8_t *const out[lanes],
+                                                  std::size_t count) {
+    const __m256i bswap = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,  //
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m256i seven = _mm256_set1_epi32(7);
+    const __m256i low_byte = _mm256_set1_epi32(0xff);
+    const __m256i entry_mask = _mm256_set1_epi32(0xffff);
+    const __m256i index_mask = _mm256_set1_epi32((1 << Width) - 1);
+    const int *base_ints = reinterpret_cast<const int *>(base);
+    const int *table_ints = reinterpret_cast<const int *>(table);
+
+    __m256i cursors =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bits));
+    alignas(32) uint32_t words[lanes];
+    for (std::size_t i = 0; i < count; i += 4) {
+        __m256i symbols = _mm256_setzero_si256();
+        for (int j = 0; j < 4; ++j) {
+            __m256i window = _mm256_i32gather_epi32(
+                base_ints, _mm256_srli_epi32(cursors, 3), 1);
+            __m256i index;
+            if constexpr (Order == Layout::lsb_first) {
+                window = _mm256_srlv_epi32(window,
+                                           _mm256_and_si256(cursors, seven));
+                index = _mm256_and_si256(window, index_mask);
+            } else {
+                window = _mm256_shuffle_epi8(window, bswap);
+                window = _mm256_sllv_epi32(window,
+                                           _mm256_and_si256(cursors, seven));
+                index = _mm256_srli_epi32(window, 32 - Width);
+            }
+            __m256i entries = _mm256_and_si256(
+                _mm256_i32gather_epi32(table_ints, index, 2), entry_mask);
+            symbols = _mm256_or_si256(
+                symbols,
+                _mm256_sll_epi32(_mm256_and_si256(entries, low_byte),
+                                 _mm_cvtsi32_si128(8 * j)));
+            cursors = _mm256_add_epi32(cursors, _mm256_srli_epi32(entries, 8));
+        }
+        _mm256_store_si256(reinterpret_cast<__m256i *>(words), symbols);
+        for (std::size_t lane = 0; lane < lanes; ++lane) {
+            std::memcpy(out[lane] + i, &words[lane], 4);
+        }
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(bits), cursors);
+}
+
+}  // namespace
+
+void decode_avx2(const DecodeTable &table, const uint8_t *base,
+                 uint32_t bits[lanes], uint8_t *const out[lanes],
+                 std::size_t count) {
+    dispatch(table.width, [&](auto width) {
+        if (table.layout == Layout::lsb_first) {
+            decode_lanes<width, Layout::lsb_first>(table.entries.data(), base,
+                                                   bits, out, count);
+        } else {
+            decode_lanes<width, Layout::msb_first>(table.entries.data(), base,
+                                                   bits, out, count);
+        }
+    });
+}
+
+#else
+
+void decode_avx2(const DecodeTable &, const uint8_t *, uint32_t[lanes],
+                 uint8_t *const[lanes], std::size_t) {}
+
+#endif
+
+}  // namespace HuffmanCoding
@@ -0,0 +1,100 @@
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace HuffmanCoding {
+
+/**
+ * Decode kernels, picked at runtime from what the CPU supports so the same
+ * binary runs on every host
+ */
+enum class Kernel { scalar, avx2 };
+constexpr std::size_t kernels = 2;
+constexpr std::array<std::string_view, kernels> kernel_names = {"scalar",
+                                                                "avx2"};
+// streams the vector kernels decode side by side, one per block
+constexpr std::size_t lanes = 8;
+
+std::optional<Kernel> parse_kernel(std::string_view name);
+bool supported(Kernel kernel);
+// the kernel decode uses, the best supported one unless overridden
+Kernel kernel();
+void set_kernel(Kernel kernel);
+
+/**
+ * Order the codes of a block are packed in. MSB-first fills every byte from
+ * its top bit down with the codes as they are. LSB-first fills it from the
+ * bottom bit up with the codes bit-reversed, so a little-endian load shifted
+ * right to the cursor holds the next code in its low bits, and every block
+ * ends with lsb_padding zero bytes so that load never needs a bounds check.
+ */
+enum class Layout { msb_first, lsb_first };
+constexpr std::size_t layouts = 2;
+constexpr std::array<std::string_view, layouts> layout_names = {"msb", "lsb"};
+constexpr std::size_t lsb_padding = 8;
+
+std::optional<Layout> parse_layout(std::string_view name);
+
+/*
+ * Every kernel is instantiated per width, the smallest of these that holds
+ * the longest code, so shifts and refills are constants the compiler can
+ * unroll
+ */
+constexpr std::array<std::size_t, 3> widths = {8, 12, 16};
+
+// width for codes of up to max_length bits, 0 when none holds them
+std::size_t width(std::size_t max_length);
+
+/**
+ * Canonical codes packed as code << 8 | length, indexed by symbol, with
+ * the code bit-reversed for lsb_first
+ */
+struct EncodeTable {
+    Layout layout = Layout::msb_first;
+    std::size_t width = 0;
+    std::array<uint32_t, 256> codes = {0};
+};
+
+/**
+ * Every width-bit prefix packed as symbol | length << 8, read from the low
+ * bit up for lsb_first. The entry past the end pads the table for the
+ * 32-bit gathers.
+ */
+struct DecodeTable {
+    Layout layout = Layout::msb_first;
+    std::size_t width = 0;
+    std::vector<uint16_t> entries;
+};
+
+// writes the codes of in to out in the table's layout, returns the bytes
+// written, with the padding of lsb_first
+std::size_t encode_block(const EncodeTable &table, const uint8_t *in,
+                         std::size_t size, uint8_t *out);
+
+// never reads outside [in, in + in_size), even for corrupt input. bits_read
+// resumes a block another call or a vector kernel stopped in, the cursor
+// past the last code is returned. An lsb_first block only runs into its
+// padding when corrupt, the output left is then zeroed
+std::size_t decode_block(const DecodeTable &table, const uint8_t *in,
+                         std::size_t in_size, uint8_t *out,
+                         std::size_t out_size, std::size_t bits_read = 0);
+
+/*
+ * Decodes count symbols from each of the lanes streams. Stream i
+ * starts at bit bits[i] of base and is written to out[i]; bits is advanced
+ * past what was consumed. count must be a multiple of 4, and every stream
+ * must be readable 4 bytes past its last code.
+ */
+void decode_avx2(const DecodeTable &table, const uint8_t *base,
+                 uint32_t bits[lanes], uint8_t *const out[lanes],
+                 std::size_t count);
+
+}  // namespace HuffmanCoding
+
+#endif
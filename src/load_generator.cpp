@@ -0,0 +1,191 @@
+#include "load_generator.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "protocol.hpp"
+#include "utils/bench.hpp"
+#include "utils/byte_stream.hpp"
+#include "utils/json.hpp"
+#include "utils/print.hpp"
+
+namespace {
+
+// distinct slices of the input, so requests do not all share one table
+constexpr std::size_t slices = 16;
+
+struct Client {
+    std::vector<double> compress;  // seconds per request
+    std::vector<double> decompress;
+    std::size_t encoded_size = 0;  // summed over requests
+    std::size_t failures = 0;      // error responses and wrong roundtrips
+    std::string error;             // of the connection, ending the client
+};
+
+void run_client(const LoadGenerator::Options &options,
+                std::span<const uint8_t> input, std::size_t index,
+                Client &client) {
+    int socket = Protocol::connect(options.socket_path);
+    if (socket == -1) {
+        client.error = std::format("cannot connect to {}", options.socket_path);
+        return;
+    }
+    Protocol::Frame request{.descriptor = options.descriptors};
+    Protocol::Frame response;
+    std::vector<uint8_t> encoded;
+    std::vector<uint8_t> decoded;
+    for (std::size_t i = 0; i < options.requests; ++i) {
+        std::span<const uint8_t> in = input.subspan(
+            (index + i * options.clients) % slices * options.size,
+            options.size);
+        request.operation = Protocol::Operation::compress;
+        Bench bench;
+        if (!Protocol::call(socket, request, in, response, encoded)) {
+            client.error = "connection lost";
+            break;
+        }
+        client.compress.push_back(bench.elapsed());
+        if (response.status != Protocol::Status::ok) {
+            ++client.failures;
+            continue;
+        }
+        client.encoded_size += encoded.size();
+
+        request.operation = Protocol::Operation::decompress;
+        bench.reset();
+        if (!Protocol::call(socket, request, encoded, response, decoded)) {
+            client.error = "connection lost";
+            break;
+        }
+        client.decompress.push_back(bench.elapsed());
+        if (response.status != Protocol::Status::ok ||
+            !std::ranges::equal(in, decoded)) {
+            ++client.failures;
+        }
+    }
+    close(socket);
+}
+
+void write_latency(Json &json, const Samples &samples) {
+    json.begin_object()
+        .key("p50")
+        .value(samples.percentile(50))
+        .key("p99")
+        .value(samples.percentile(99))
+        .key("p999")
+        .value(samples.percentile(99.9))
+        .key("min")
+        .value(samples.min())
+        .key("mean")
+        .value(samples.mean())
+        .end_object();
+}
+
+// the server's stats, empty if it cannot be reached
+std::string server_stats(const std::string &socket_path) {
+    int socket = Protocol::connect(socket_path);
+    if (socket == -1) {
+        return "";
+    }
+    Protocol::Frame request{.operation = Protocol::Operation::stats};
+    Protocol::Frame response;
+    std::vector<uint8_t> stats;
+    bool received = Protocol::call(socket, request, {}, response, stats);
+    close(socket);
+    if (!received || response.status != Protocol::Status::ok) {
+        return "";
+    }
+    return std::string(stats.begin(), stats.end());
+}
+
+}  // namespace
+
+std::string LoadGenerator::run(const Options &options) {
+    std::filesystem::path directory =
+        options.directory.empty()
+            ? std::filesystem::temp_directory_path()
+            : std::filesystem::path(options.directory);
+    std::string pathname = directory / "sloth-load";
+    TestFile::generate(pathname, slices * options.size, options.corpus,
+                       options.seed);
+    IByteStream ibs(pathname);
+    std::filesystem::remove(pathname);
+    std::span<const uint8_t> input(ibs.map(), ibs.size());
+
+    std::vector<Client> clients(options.clients);
+    std::vector<std::thread> threads;
+    Bench bench;
+    for (std::size_t i = 0; i < options.clients; ++i) {
+        threads.emplace_back(run_client, std::cref(options), input, i,
+                             std::ref(clients[i]));
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    double seconds = bench.elapsed();
+
+    Samples compress;
+    Samples decompress;
+    std::size_t roundtrips = 0;
+    std::size_t encoded_size = 0;
+    std::size_t failures = 0;
+    for (const Client &client : clients) {
+        if (!client.error.empty()) {
+            println("Error: {}", client.error);
+            exit(EXIT_FAILURE);
+        }
+        for (double value : client.compress) {
+            compress.add(value);
+        }
+        for (double value : client.decompress) {
+            decompress.add(value);
+        }
+        roundtrips += client.decompress.size();
+        encoded_size += client.encoded_size;
+        failures += client.failures;
+    }
+
+    Json json;
+    json.begin_object()
+        .key("clients")
+        .value(options.clients)
+        .key("requests")
+        .value(options.clients * options.requests)
+        .key("size")
+        .value(options.size)
+        .key("corpus")
+        .value(TestFile::corpus_names[static_cast<std::size_t>(
+            options.corpus)])
+        .key("descriptors")
+        .value(options.descriptors)
+        .key("seconds")
+        .value(seconds)
+        .key("roundtrips_s")
+        .value(roundtrips / seconds)
+        .key("mb_s")
+        .value(roundtrips * options.size / 1e6 / seconds)
+        .key("ratio")
+        .value(roundtrips * options.size / static_cast<double>(encoded_size))
+        .key("failures")
+        .value(failures);
+    json.key("compress");
+    write_latency(json, compress);
+    json.key("decompress");
+    write_latency(json, decompress);
+    std::string stats = server_stats(options.socket_path);
+    json.key("server");
+    if (stats.empty()) {
+        json.null();
+    } else {
+        json.raw(stats);
+    }
+    json.end_object();
+    return json.str();
+}
@@ -0,0 +1,33 @@
+#ifndef LOAD_GENERATOR_HPP
+#define LOAD_GENERATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "test_file.hpp"
+
+/**
+ * Client of Server measuring its throughput and tail latency. Every client
+ * thread holds one connection and sends requests back to back, each a
+ * compress of a slice of a generated input followed by a decompress of the
+ * result, checked against the slice.
+ */
+class LoadGenerator {
+   public:
+    struct Options {
+        std::string socket_path;
+        std::size_t clients = 4;     // concurrent connections
+        std::size_t requests = 256;  // roundtrips per client
+        std::size_t size = 64 << 10;  // bytes per request
+        TestFile::Corpus corpus = TestFile::Corpus::logs;
+        uint64_t seed = TestFile::default_seed;
+        bool descriptors = false;  // payloads passed as memfds
+        std::string directory;     // scratch space for the generated input
+    };
+
+    // returns a JSON report, with the server's stats once done
+    static std::string run(const Options &options);
+};
+
+#endif
@@ -1,11 +1,22 @@
 #include <getopt.h>
 #include <omp.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
 #include <string>
 #include <vector>
 
+#include "benchmark.hpp"
 #include "huffman_coding.hpp"
+#include "kernels.hpp"
+#include "load_generator.hpp"
+#include "protocol.hpp"
+#include "server.hpp"
 #include "test_file.hpp"
 #include "utils/bench.hpp"
 #include "utils/print.hpp"
@@ -18,6 +29,139 @@ void print_usage(std::string error = "") {
           error == "" ? "" : "\n    " + error);
 }
 
+// an encode level, from HuffmanCoding::min_level to max_level
+std::optional<int> parse_level(const std::string& text) {
+    int level;
+    try {
+        level = std::stoi(text);
+    } catch (const std::exception&) {
+        return std::nullopt;
+    }
+    if (level < HuffmanCoding::min_level || level > HuffmanCoding::max_level) {
+        return std::nullopt;
+    }
+    return level;
+}
+
+// bytes, with an optional K, M or G suffix in powers of 1024
+std::optional<std::size_t> parse_bytes(const std::string& text) {
+    std::size_t end;
+    std::size_t value;
+    try {
+        value = std::stoull(text, &end);
+    } catch (const std::exception&) {
+        return std::nullopt;
+    }
+    std::string suffix = text.substr(end);
+    if (suffix == "K") {
+        return value << 10;
+    } else if (suffix == "M") {
+        return value << 20;
+    } else if (suffix == "G") {
+        return value << 30;
+    } else if (!suffix.empty()) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+// what a command taking processor options does with its files
+enum class Processing { encode, decode, verify };
+
+/*
+ * Options of zip, append, unzip and verify, every other argument is a file
+ * name. Only encode takes --layout and --level, only decode --async.
+ * Setting the threads, pinning or NUMA-local blocks implies --parallel.
+ */
+bool parse_processor_options(int argc, char** argv, Processing processing,
+                             bool& parallel, HuffmanCoding::Options& options,
+                             std::vector<std::string>& pathnames) {
+    std::vector<struct option> long_options = {
+        {"parallel", no_argument, 0, 'p'},
+        {"max-memory", required_argument, 0, 'm'},
+        {"threads", required_argument, 0, 't'},
+        {"pin", no_argument, 0, 'P'},
+        {"numa-local", no_argument, 0, 'L'}};
+    std::string short_options = "+pm:t:PL";
+    if (processing == Processing::encode) {
+        long_options.push_back({"layout", required_argument, 0, 'b'});
+        long_options.push_back({"level", required_argument, 0, 'l'});
+        short_options += "b:l:";
+    } else if (processing == Processing::decode) {
+        long_options.push_back({"async", no_argument, 0, 'a'});
+        short_options += "a";
+    }
+    long_options.push_back({0, 0, 0, 0});
+    char c;
+    optind = 2;
+    while (optind < argc) {
+        if ((c = getopt_long(argc, argv, short_options.c_str(),
+                             long_options.data(), 0)) != -1) {
+            switch (c) {
+                case 'p': {
+                    parallel = true;
+                    break;
+                }
+                case 'm': {
+                    std::optional<std::size_t> bytes = parse_bytes(optarg);
+                    if (!bytes) {
+                        print_usage("invalid memory limit " +
+                                    std::string(optarg));
+                        return false;
+                    }
+                    options.max_memory = *bytes;
+                    break;
+                }
+                case 't': {
+                    options.threads = std::stoi(optarg);
+                    parallel = true;
+                    break;
+                }
+                case 'P': {
+                    options.pin = true;
+                    parallel = true;
+                    break;
+                }
+                case 'L': {
+                    options.numa_local = true;
+                    parallel = true;
+                    break;
+                }
+                case 'a': {
+                    options.async_io = true;
+                    break;
+                }
+                case 'b': {
+                    std::optional<HuffmanCoding::Layout> layout =
+                        HuffmanCoding::parse_layout(optarg);
+                    if (!layout) {
+                        print_usage("unknown layout " + std::string(optarg));
+                        return false;
+                    }
+                    options.layout = *layout;
+                    break;
+                }
+                case 'l': {
+                    std::optional<int> level = parse_level(optarg);
+                    if (!level) {
+                        print_usage("invalid level " + std::string(optarg));
+                        return false;
+                    }
+                    options.level = *level;
+                    break;
+                }
+                case '?': {
+                    return false;
+                }
+            }
+        } else {
+            pathnames.emplace_back(argv[optind]);
+            ++optind;
+        }
+    }
+    return true;
+}
+
 int main(int argc, char** argv) {
     if (argc < 2) {
         print_usage();
@@ -30,32 +174,41 @@ int main(int argc, char** argv) {
                 "test requires a file name and at least 1 factor in 0.5GB");
             return EXIT_FAILURE;
         }
-        std::string pathname = argv[2];
-#pragma omp parallel for
-        for (int i = 3; i < argc; ++i) {
-            std::size_t factor = std::stoul(argv[i]);
-            Bench bench;
-            TestFile::generate(pathname + std::to_string(factor), 5e8 * factor);
-            print("Generated {} in {}\n", factor, bench.format());
-        }
-    } else if (command == "zip") {
-        if (argc < 3) {
-            print_usage("zip requires at least 1 file name");
-            return EXIT_FAILURE;
-        }
 
-        std::vector<std::string> pathnames;
-        bool parallel = false;
+        std::vector<std::string> arguments;
+        std::vector<TestFile::Corpus> corpora;
+        uint64_t seed = TestFile::default_seed;
 
         static struct option long_options[] = {
-            {"parallel", no_argument, 0, 'p'}, {0, 0, 0, 0}};
+            {"corpus", required_argument, 0, 'c'},
+            {"seed", required_argument, 0, 's'},
+            {0, 0, 0, 0}};
         char c;
         optind = 2;
         while (optind < argc) {
-            if ((c = getopt_long(argc, argv, "p", long_options, 0)) != -1) {
+            if ((c = getopt_long(argc, argv, "+c:s:", long_options, 0)) != -1) {
                 switch (c) {
-                    case 'p': {
-                        parallel = true;
+                    case 'c': {
+                        if (std::string(optarg) == "all") {
+                            for (std::size_t i = 0; i < TestFile::corpora;
+                                 ++i) {
+                                corpora.push_back(
+                                    static_cast<TestFile::Corpus>(i));
+                            }
+                            break;
+                        }
+                        std::optional<TestFile::Corpus> corpus =
+                            TestFile::parse(optarg);
+                        if (!corpus) {
+                            print_usage("unknown corpus " +
+                                        std::string(optarg));
+                            return EXIT_FAILURE;
+                        }
+                        corpora.push_back(*corpus);
+                        break;
+                    }
+                    case 's': {
+                        seed = std::stoull(optarg);
                         break;
                     }
                     case '?': {
@@ -63,25 +216,103 @@ int main(int argc, char** argv) {
                     }
                 }
             } else {
-                pathnames.emplace_back(argv[optind]);
+                arguments.emplace_back(argv[optind]);
                 ++optind;
             }
         }
+        if (arguments.size() < 2) {
+            print_usage(
+                "test requires a file name and at least 1 factor in 0.5GB");
+            return EXIT_FAILURE;
+        }
+        if (corpora.empty()) {
+            corpora.push_back(TestFile::Corpus::poisson);
+        }
+
+        // files are generated one at a time, each in parallel
+        std::string pathname = arguments[0];
+        for (std::size_t i = 1; i < arguments.size(); ++i) {
+            std::size_t factor = std::stoul(arguments[i]);
+            for (TestFile::Corpus corpus : corpora) {
+                std::string name(
+                    TestFile::corpus_names[static_cast<std::size_t>(corpus)]);
+                Bench bench;
+                TestFile::generate(
+                    pathname + "-" + name + std::to_string(factor),
+                    5e8 * factor, corpus, seed);
+                print("Generated {} {} in {}\n", name, factor, bench.format());
+            }
+        }
+    } else if (command == "zip") {
+        if (argc < 3) {
+            print_usage("zip requires at least 1 file name");
+            return EXIT_FAILURE;
+        }
+
+        std::vector<std::string> pathnames;
+        bool parallel = false;
+        HuffmanCoding::Context context;
+        if (!parse_processor_options(argc, argv, Processing::encode, parallel,
+                                     context.options_, pathnames)) {
+            return EXIT_FAILURE;
+        }
         if (parallel) {
             for (const std::string& pathname : pathnames) {
                 Bench bench;
-                HuffmanCoding::Parallel::Processor::encode(
-                    pathname, pathname + file_extension);
+                std::size_t encoded_size =
+                    HuffmanCoding::Parallel::Processor::encode(
+                        context, pathname, pathname + file_extension);
+                std::size_t size = std::filesystem::file_size(pathname);
+                if (encoded_size > size) {
+                    println(
+                        "sloth: compressed file will be larger than original "
+                        "hahaha");
+                }
+                println("sloth: Compression ratio: {:.2f}",
+                        size / static_cast<double>(encoded_size));
                 print("Zipped {} in {}\n", pathname, bench.format());
             }
         } else {
             for (const std::string& pathname : pathnames) {
                 Bench bench;
-                HuffmanCoding::Serial::Processor::encode(
-                    pathname, pathname + file_extension);
+                std::size_t encoded_size =
+                    HuffmanCoding::Serial::Processor::encode(
+                        context, pathname, pathname + file_extension);
+                std::size_t size = std::filesystem::file_size(pathname);
+                if (encoded_size > size) {
+                    println(
+                        "sloth: compressed file will be larger than original "
+                        "hahaha");
+                }
+                println("sloth: Compression ratio: {:.2f}",
+                        size / static_cast<double>(encoded_size));
                 print("Zipped {} in {}\n", pathname, bench.format());
             }
         }
+    } else if (command == "append") {
+        if (argc < 3) {
+            print_usage("append requires at least 1 file name");
+            return EXIT_FAILURE;
+        }
+
+        // only the bytes added to each file since it was zipped are encoded
+        std::vector<std::string> pathnames;
+        bool parallel = false;
+        HuffmanCoding::Context context;
+        if (!parse_processor_options(argc, argv, Processing::encode, parallel,
+                                     context.options_, pathnames)) {
+            return EXIT_FAILURE;
+        }
+        for (const std::string& pathname : pathnames) {
+            Bench bench;
+            std::size_t appended =
+                parallel ? HuffmanCoding::Parallel::Processor::append(
+                               context, pathname, pathname + file_extension)
+                         : HuffmanCoding::Serial::Processor::append(
+                               context, pathname, pathname + file_extension);
+            print("Appended {} bytes to {} in {}\n", appended,
+                  pathname + file_extension, bench.format());
+        }
     } else if (command == "unzip") {
         if (argc < 3) {
             print_usage("unzip requires at least 1 file name");
@@ -99,16 +330,132 @@ int main(int argc, char** argv) {
             }
         }
         bool parallel = false;
+        HuffmanCoding::Context context;
+        if (!parse_processor_options(argc, argv, Processing::decode, parallel,
+                                     context.options_, pathnames)) {
+            return EXIT_FAILURE;
+        }
+        if (parallel) {
+            for (const std::string& pathname : pathnames) {
+                Bench bench;
+                HuffmanCoding::Parallel::Processor::decode(context, pathname,
+                                                           pathname);
+                print("Unzipped {} in {}\n", pathname, bench.format());
+            }
+        } else {
+            for (const std::string& pathname : pathnames) {
+                Bench bench;
+                HuffmanCoding::Serial::Processor::decode(context, pathname,
+                                                         pathname);
+                print("Unzipped {} in {}\n", pathname, bench.format());
+            }
+        }
+    } else if (command == "verify") {
+        if (argc < 3) {
+            print_usage("verify requires at least 1 file name");
+            return EXIT_FAILURE;
+        }
+
+        std::vector<std::string> pathnames;
+        bool parallel = false;
+        HuffmanCoding::Context context;
+        if (!parse_processor_options(argc, argv, Processing::verify, parallel,
+                                     context.options_, pathnames)) {
+            return EXIT_FAILURE;
+        }
+        bool ok = true;
+        for (const std::string& pathname : pathnames) {
+            Bench bench;
+            HuffmanCoding::Verification verification =
+                parallel ? HuffmanCoding::Parallel::Processor::verify(context,
+                                                                      pathname)
+                         : HuffmanCoding::Serial::Processor::verify(context,
+                                                                    pathname);
+            if (!verification.error.empty()) {
+                println("sloth: {} is corrupt: {}", pathname,
+                        verification.error);
+            }
+            for (std::size_t block : verification.corrupt) {
+                println("sloth: {} is corrupt: checksum mismatch in block {}",
+                        pathname, block);
+            }
+            ok = ok && verification.ok();
+            print("Verified {} ({}/{} blocks ok) in {}\n", pathname,
+                  verification.blocks - verification.corrupt.size(),
+                  verification.blocks, bench.format());
+        }
+        if (!ok) {
+            return EXIT_FAILURE;
+        }
+    } else if (command == "cat") {
+        if (argc < 3) {
+            print_usage("cat requires at least 1 file name");
+            return EXIT_FAILURE;
+        }
+
+        // decoded bytes to stdout, pulled in batches as a parser would
+        for (int i = 2; i < argc; ++i) {
+            HuffmanCoding::Decoder decoder(argv[i]);
+            for (std::span<const uint8_t> batch : decoder.batches(1 << 16)) {
+                std::cout.write(reinterpret_cast<const char*>(batch.data()),
+                                batch.size());
+            }
+            if (!decoder.error().empty()) {
+                std::cout.flush();
+                std::cerr << std::format("sloth: {} is corrupt: {}\n", argv[i],
+                                         decoder.error());
+                return EXIT_FAILURE;
+            }
+        }
+    } else if (command == "estimate") {
+        if (argc < 3) {
+            print_usage("estimate requires at least 1 file name");
+            return EXIT_FAILURE;
+        }
+
+        std::vector<std::string> pathnames;
+        double fraction = 1;
+        // of the encode to predict
+        HuffmanCoding::Options options;
 
         static struct option long_options[] = {
-            {"parallel", no_argument, 0, 'p'}, {0, 0, 0, 0}};
+            {"sample", required_argument, 0, 's'},
+            {"layout", required_argument, 0, 'b'},
+            {"level", required_argument, 0, 'l'},
+            {0, 0, 0, 0}};
         char c;
         optind = 2;
         while (optind < argc) {
-            if ((c = getopt_long(argc, argv, "p", long_options, 0)) != -1) {
+            if ((c = getopt_long(argc, argv, "+s:b:l:", long_options, 0)) !=
+                -1) {
                 switch (c) {
-                    case 'p': {
-                        parallel = true;
+                    case 's': {
+                        fraction = std::stod(optarg);
+                        if (!(fraction > 0 && fraction <= 1)) {
+                            print_usage("sample requires a fraction in (0, 1]");
+                            return EXIT_FAILURE;
+                        }
+                        break;
+                    }
+                    case 'b': {
+                        std::optional<HuffmanCoding::Layout> layout =
+                            HuffmanCoding::parse_layout(optarg);
+                        if (!layout) {
+                            print_usage("unknown layout " +
+                                        std::string(optarg));
+                            return EXIT_FAILURE;
+                        }
+                        options.layout = *layout;
+                        break;
+                    }
+                    case 'l': {
+                        std::optional<int> level = parse_level(optarg);
+                        if (!level) {
+                            print_usage("invalid level " +
+                                        std::string(optarg));
+                            return EXIT_FAILURE;
+                        }
+                        options.level = *level;
                         break;
                     }
                     case '?': {
@@ -120,18 +467,367 @@ int main(int argc, char** argv) {
                 ++optind;
             }
         }
-        if (parallel) {
-            for (const std::string& pathname : pathnames) {
-                Bench bench;
-                HuffmanCoding::Parallel::Processor::decode(pathname, pathname);
-                print("Unzipped {} in {}\n", pathname, bench.format());
+
+        // one file is split across threads, many files get a thread each
+        Bench bench;
+        std::vector<HuffmanCoding::Estimate> estimates(pathnames.size());
+        if (pathnames.size() == 1) {
+            HuffmanCoding::Context context;
+            context.options_ = options;
+            estimates[0] = HuffmanCoding::Parallel::Processor::estimate(
+                context, pathnames[0], fraction);
+        } else {
+#pragma omp parallel for schedule(dynamic)
+            for (std::size_t i = 0; i < pathnames.size(); ++i) {
+                HuffmanCoding::Context context;
+                context.options_ = options;
+                estimates[i] = HuffmanCoding::Serial::Processor::estimate(
+                    context, pathnames[i], fraction);
             }
+        }
+        for (std::size_t i = 0; i < pathnames.size(); ++i) {
+            const HuffmanCoding::Estimate& estimate = estimates[i];
+            // an empty file, as zip reports it, has ratio 0 and was read
+            // whole
+            bool empty = estimate.size == 0;
+            println("{}: {} -> {} bytes, ratio {:.2f} (sampled {:.1f}%)",
+                    pathnames[i], estimate.size, estimate.encoded_size,
+                    estimate.size / static_cast<double>(estimate.encoded_size),
+                    empty ? 100.0 : 100.0 * estimate.sampled / estimate.size);
+        }
+        print("Estimated {} files in {}\n", pathnames.size(), bench.format());
+    } else if (command == "serve") {
+        if (argc < 3) {
+            print_usage("serve requires a socket path");
+            return EXIT_FAILURE;
+        }
+
+        Server::Options options;
+        std::vector<std::string> arguments;
+
+        static struct option long_options[] = {
+            {"threads", required_argument, 0, 't'},
+            {"pin", no_argument, 0, 'P'},
+            {"small", required_argument, 0, 's'},
+            {"batch", required_argument, 0, 'b'},
+            {"level", required_argument, 0, 'l'},
+            {"max-size", required_argument, 0, 'm'},
+            {0, 0, 0, 0}};
+        char c;
+        optind = 2;
+        while (optind < argc) {
+            if ((c = getopt_long(argc, argv, "+t:Ps:b:l:m:", long_options,
+                                 0)) != -1) {
+                switch (c) {
+                    case 't': {
+                        options.processor.threads = std::stoi(optarg);
+                        break;
+                    }
+                    case 'P': {
+                        options.processor.pin = true;
+                        break;
+                    }
+                    case 's': {
+                        std::optional<std::size_t> bytes = parse_bytes(optarg);
+                        if (!bytes) {
+                            print_usage("invalid size " + std::string(optarg));
+                            return EXIT_FAILURE;
+                        }
+                        options.small_size = *bytes;
+                        break;
+                    }
+                    case 'm': {
+                        std::optional<std::size_t> bytes = parse_bytes(optarg);
+                        if (!bytes || *bytes == 0) {
+                            print_usage("invalid size " + std::string(optarg));
+                            return EXIT_FAILURE;
+                        }
+                        options.max_size = *bytes;
+                        break;
+                    }
+                    case 'b': {
+                        options.max_batch = std::max(1ul, std::stoul(optarg));
+                        break;
+                    }
+                    case 'l': {
+                        std::optional<int> level = parse_level(optarg);
+                        if (!level) {
+                            print_usage("invalid level " +
+                                        std::string(optarg));
+                            return EXIT_FAILURE;
+                        }
+                        options.processor.level = *level;
+                        break;
+                    }
+                    case '?': {
+                        return EXIT_FAILURE;
+                    }
+                }
+            } else {
+                arguments.emplace_back(argv[optind]);
+                ++optind;
+            }
+        }
+        if (arguments.size() != 1) {
+            print_usage("serve requires a socket path");
+            return EXIT_FAILURE;
+        }
+        options.socket_path = arguments[0];
+
+        println("Serving on {}", options.socket_path);
+        std::string error = Server::run(options);
+        if (!error.empty()) {
+            println("Error: {}", error);
+            return EXIT_FAILURE;
+        }
+    } else if (command == "load") {
+        if (argc < 3) {
+            print_usage("load requires a socket path");
+            return EXIT_FAILURE;
+        }
+
+        LoadGenerator::Options options;
+        std::vector<std::string> arguments;
+        std::string output;
+        bool shutdown = false;
+
+        static struct option long_options[] = {
+            {"clients", required_argument, 0, 'c'},
+            {"requests", required_argument, 0, 'n'},
+            {"size", required_argument, 0, 's'},
+            {"corpus", required_argument, 0, 'C'},
+            {"seed", required_argument, 0, 'S'},
+            {"descriptors", no_argument, 0, 'f'},
+            {"dir", required_argument, 0, 'd'},
+            {"output", required_argument, 0, 'o'},
+            {"shutdown", no_argument, 0, 'x'},
+            {0, 0, 0, 0}};
+        char c;
+        optind = 2;
+        while (optind < argc) {
+            if ((c = getopt_long(argc, argv, "+c:n:s:C:S:fd:o:x", long_options,
+                                 0)) != -1) {
+                switch (c) {
+                    case 'c': {
+                        options.clients = std::max(1ul, std::stoul(optarg));
+                        break;
+                    }
+                    case 'n': {
+                        options.requests = std::stoul(optarg);
+                        break;
+                    }
+                    case 's': {
+                        std::optional<std::size_t> bytes = parse_bytes(optarg);
+                        if (!bytes || *bytes == 0) {
+                            print_usage("invalid size " + std::string(optarg));
+                            return EXIT_FAILURE;
+                        }
+                        options.size = *bytes;
+                        break;
+                    }
+                    case 'C': {
+                        std::optional<TestFile::Corpus> corpus =
+                            TestFile::parse(optarg);
+                        if (!corpus) {
+                            print_usage("unknown corpus " +
+                                        std::string(optarg));
+                            return EXIT_FAILURE;
+                        }
+                        options.corpus = *corpus;
+                        break;
+                    }
+                    case 'S': {
+                        options.seed = std::stoull(optarg);
+                        break;
+                    }
+                    case 'f': {
+                        options.descriptors = true;
+                        break;
+                    }
+                    case 'd': {
+                        options.directory = optarg;
+                        break;
+                    }
+                    case 'o': {
+                        output = optarg;
+                        break;
+                    }
+                    case 'x': {
+                        shutdown = true;
+                        break;
+                    }
+                    case '?': {
+                        return EXIT_FAILURE;
+                    }
+                }
+            } else {
+                arguments.emplace_back(argv[optind]);
+                ++optind;
+            }
+        }
+        if (arguments.size() != 1) {
+            print_usage("load requires a socket path");
+            return EXIT_FAILURE;
+        }
+        options.socket_path = arguments[0];
+
+        std::string report = LoadGenerator::run(options);
+        if (output.empty()) {
+            println("{}", report);
         } else {
-            for (const std::string& pathname : pathnames) {
-                Bench bench;
-                HuffmanCoding::Serial::Processor::decode(pathname, pathname);
-                print("Unzipped {} in {}\n", pathname, bench.format());
+            std::ofstream(output) << report << '\n';
+        }
+        // stops the server once measured, answered before it exits
+        if (shutdown) {
+            int socket = Protocol::connect(options.socket_path);
+            Protocol::Frame request{.operation =
+                                        Protocol::Operation::shutdown};
+            Protocol::Frame response;
+            std::vector<uint8_t> payload;
+            if (socket == -1 ||
+                !Protocol::call(socket, request, {}, response, payload)) {
+                println("Error: cannot shut down {}", options.socket_path);
+                return EXIT_FAILURE;
             }
+            close(socket);
+        }
+    } else if (command == "bench") {
+        Benchmark::Options options;
+        std::string output;
+
+        static struct option long_options[] = {
+            {"threads", required_argument, 0, 't'},
+            {"trials", required_argument, 0, 'n'},
+            {"size", required_argument, 0, 's'},
+            {"dir", required_argument, 0, 'd'},
+            {"output", required_argument, 0, 'o'},
+            {"counters", no_argument, 0, 'c'},
+            {"corpus", required_argument, 0, 'C'},
+            {"seed", required_argument, 0, 'S'},
+            {"kernel", required_argument, 0, 'k'},
+            {"placement", no_argument, 0, 'P'},
+            {"layout", required_argument, 0, 'b'},
+            {"level", required_argument, 0, 'l'},
+            {0, 0, 0, 0}};
+        char c;
+        optind = 2;
+        while (optind < argc) {
+            if ((c = getopt_long(argc, argv, "+t:n:s:d:o:cC:S:k:Pb:l:",
+                                 long_options, 0)) != -1) {
+                switch (c) {
+                    case 't': {
+                        std::string threads(optarg);
+                        for (std::size_t i = 0; i < threads.size();) {
+                            std::size_t end = threads.find(',', i);
+                            if (end == std::string::npos) {
+                                end = threads.size();
+                            }
+                            options.threads.push_back(
+                                std::stoi(threads.substr(i, end - i)));
+                            i = end + 1;
+                        }
+                        break;
+                    }
+                    case 'n': {
+                        options.trials = std::stoul(optarg);
+                        break;
+                    }
+                    case 's': {
+                        options.size = std::stoul(optarg) * 1e6;
+                        break;
+                    }
+                    case 'd': {
+                        options.directory = optarg;
+                        break;
+                    }
+                    case 'o': {
+                        output = optarg;
+                        break;
+                    }
+                    case 'c': {
+                        options.counters = true;
+                        break;
+                    }
+                    case 'C': {
+                        std::optional<TestFile::Corpus> corpus =
+                            TestFile::parse(optarg);
+                        if (!corpus) {
+                            print_usage("unknown corpus " +
+                                        std::string(optarg));
+                            return EXIT_FAILURE;
+                        }
+                        options.corpora.push_back(*corpus);
+                        break;
+                    }
+                    case 'S': {
+                        options.seed = std::stoull(optarg);
+                        break;
+                    }
+                    case 'k': {
+                        std::optional<HuffmanCoding::Kernel> kernel =
+                            HuffmanCoding::parse_kernel(optarg);
+                        if (!kernel || !HuffmanCoding::supported(*kernel)) {
+                            print_usage("unsupported kernel " +
+                                        std::string(optarg));
+                            return EXIT_FAILURE;
+                        }
+                        options.kernels.push_back(*kernel);
+                        break;
+                    }
+                    case 'P': {
+                        options.placement = true;
+                        break;
+                    }
+                    case 'b': {
+                        std::optional<HuffmanCoding::Layout> layout =
+                            HuffmanCoding::parse_layout(optarg);
+                        if (!layout) {
+                            print_usage("unknown layout " +
+                                        std::string(optarg));
+                            return EXIT_FAILURE;
+                        }
+                        options.layouts.push_back(*layout);
+                        break;
+                    }
+                    case 'l': {
+                        std::optional<int> level = parse_level(optarg);
+                        if (!level) {
+                            print_usage("invalid level " +
+                                        std::string(optarg));
+                            return EXIT_FAILURE;
+                        }
+                        options.levels.push_back(*level);
+                        break;
+                    }
+                    case '?': {
+                        return EXIT_FAILURE;
+                    }
+                }
+            } else {
+                options.pathnames.emplace_back(argv[optind]);
+                ++optind;
+            }
+        }
+        if (options.threads.empty()) {
+            for (int threads = 1; threads < omp_get_max_threads();
+                 threads *= 2) {
+                options.threads.push_back(threads);
+            }
+            options.threads.push_back(omp_get_max_threads());
+        }
+
+        std::size_t max_allocations;
+        std::string report = Benchmark::run(options, max_allocations);
+        if (output.empty()) {
+            println("{}", report);
+        } else {
+            std::ofstream(output) << report << '\n';
+        }
+        // a warm Context is expected to code without touching the heap
+        if (max_allocations != 0) {
+            println("Error: a trial made {} heap allocations after warm-up",
+                    max_allocations);
+            return EXIT_FAILURE;
         }
     } else {
         print_usage();
@@ -0,0 +1,212 @@
+#include "protocol.hpp"
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+namespace Protocol {
+
+bool address(const std::string &socket_path, sockaddr_un &address) {
+    address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, socket_path.data(), socket_path.size());
+    return true;
+}
+
+int connect(const std::string &socket_path) {
+    sockaddr_un server;
+    if (!address(socket_path, server)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd != -1 && ::connect(fd, reinterpret_cast<sockaddr *>(&server),
+                              sizeof(server)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool send_all(int socket, const uint8_t *data, std::size_t size) {
+    while (size != 0) {
+        ssize_t sent = send(socket, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+bool receive_all(int socket, uint8_t *data, std::size_t size) {
+    while (size != 0) {
+        ssize_t received = recv(socket, data, size, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+bool send_frame(int socket, const Frame &frame, int fd) {
+    iovec iov = {const_cast<Frame *>(&frame), sizeof(frame)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {0};
+    msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    if (fd != -1) {
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        cmsghdr *header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+    }
+    ssize_t sent;
+    do {
+        sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent <= 0) {
+        return false;
+    }
+    // the descriptor went with the first byte, the rest is plain data
+    return send_all(socket, reinterpret_cast<const uint8_t *>(&frame) + sent,
+                    sizeof(frame) - sent);
+}
+
+bool receive_frame(int socket, Frame &frame, int &fd) {
+    fd = -1;
+    iovec iov = {&frame, sizeof(frame)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t received;
+    do {
+        received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) {
+        return false;
+    }
+    for (cmsghdr *header = CMSG_FIRSTHDR(&message); header != nullptr;
+         header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET &&
+            header->cmsg_type == SCM_RIGHTS) {
+            std::memcpy(&fd, CMSG_DATA(header), sizeof(int));
+        }
+    }
+    if (!receive_all(socket, reinterpret_cast<uint8_t *>(&frame) + received,
+                     sizeof(frame) - received) ||
+        frame.magic != magic) {
+        if (fd != -1) {
+            close(fd);
+            fd = -1;
+        }
+        return false;
+    }
+    return true;
+}
+
+bool send_payload(int socket, Frame frame, std::span<const uint8_t> payload) {
+    frame.size = payload.size();
+    if (!frame.descriptor) {
+        return send_frame(socket, frame) &&
+               send_all(socket, payload.data(), payload.size());
+    }
+    int fd = memfd_create("sloth", MFD_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    bool written = true;
+    for (std::size_t done = 0; written && done < payload.size();) {
+        ssize_t result =
+            write(fd, payload.data() + done, payload.size() - done);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        written = result > 0;
+        done += written ? result : 0;
+    }
+    bool sent = written && send_frame(socket, frame, fd);
+    close(fd);
+    return sent;
+}
+
+bool receive_payload(int socket, const Frame &frame, int fd,
+                     std::vector<uint8_t> &payload) {
+    payload.resize(frame.size);
+    if (!frame.descriptor) {
+        if (fd != -1) {
+            close(fd);
+            return false;
+        }
+        return receive_all(socket, payload.data(), payload.size());
+    }
+    if (fd == -1) {
+        return false;
+    }
+    bool read = true;
+    for (std::size_t done = 0; read && done < payload.size();) {
+        ssize_t result =
+            pread(fd, payload.data() + done, payload.size() - done, done);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        read = result > 0;
+        done += read ? result : 0;
+    }
+    close(fd);
+    return read;
+}
+
+bool skip_payload(int socket, const Frame &frame, int fd) {
+    if (frame.descriptor) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return fd != -1;
+    }
+    if (fd != -1) {
+        close(fd);
+        return false;
+    }
+    std::array<uint8_t, 1 << 16> buffer;
+    for (uint64_t left = frame.size; left != 0;) {
+        std::size_t size = std::min<uint64_t>(left, buffer.size());
+        if (!receive_all(socket, buffer.data(), size)) {
+            return false;
+        }
+        left -= size;
+    }
+    return true;
+}
+
+bool call(int socket, const Frame &request, std::span<const uint8_t> payload,
+          Frame &response, std::vector<uint8_t> &out) {
+    int fd;
+    return send_payload(socket, request, payload) &&
+           receive_frame(socket, response, fd) &&
+           receive_payload(socket, response, fd, out);
+}
+
+}  // namespace Protocol
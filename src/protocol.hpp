@@ -0,0 +1,64 @@
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include <sys/un.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+/**
+ * Framing shared by the daemon and its clients on a Unix stream socket. A
+ * request and its response are each a Frame, followed by size bytes of
+ * payload inline or, when passed as a descriptor, by nothing: the payload
+ * is then the first size bytes of a file descriptor sent along with the
+ * frame, such as a memfd.
+ */
+namespace Protocol {
+
+constexpr uint32_t magic = 0x51524c53;  // "SLRQ"
+
+enum class Operation : uint8_t { compress, decompress, stats, shutdown };
+enum class Status : uint8_t { ok, error };  // an error's payload is a message
+
+struct Frame {
+    uint32_t magic = Protocol::magic;
+    Operation operation = Operation::compress;
+    Status status = Status::ok;
+    uint8_t descriptor = 0;  // 1 when the payload is passed as one
+    uint8_t reserved = 0;
+    uint64_t size = 0;
+};
+
+// false when socket_path does not fit in a sockaddr_un
+bool address(const std::string &socket_path, sockaddr_un &address);
+// a socket connected to the server at socket_path, -1 on failure
+int connect(const std::string &socket_path);
+
+/*
+ * Every call returns false once the peer is gone or the socket fails, and
+ * retries interrupted and partial transfers
+ */
+bool send_all(int socket, const uint8_t *data, std::size_t size);
+bool receive_all(int socket, uint8_t *data, std::size_t size);
+// fd, when not -1, is passed along with the frame
+bool send_frame(int socket, const Frame &frame, int fd = -1);
+// fd is the descriptor passed along, -1 when there is none
+bool receive_frame(int socket, Frame &frame, int &fd);
+
+// sends frame with payload inline, or in a new memfd when descriptor is set
+bool send_payload(int socket, Frame frame, std::span<const uint8_t> payload);
+// the payload following frame, read from the socket or fd, which is closed
+bool receive_payload(int socket, const Frame &frame, int fd,
+                     std::vector<uint8_t> &payload);
+// reads past the payload following frame without keeping it, closes fd
+bool skip_payload(int socket, const Frame &frame, int fd);
+// one request with its payload, and the response with its own in out
+bool call(int socket, const Frame &request, std::span<const uint8_t> payload,
+          Frame &response, std::vector<uint8_t> &out);
+
+}  // namespace Protocol
+
+#endif
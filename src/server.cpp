@@ -0,0 +1,440 @@
+#include "server.hpp"
+
+#include <omp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <format>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "protocol.hpp"
+#include "table_cache.hpp"
+#include "utils/bench.hpp"
+#include "utils/json.hpp"
+
+namespace {
+
+constexpr std::size_t operations = 2;  // compress and decompress
+// how long ended connections may wait for their thread to be joined
+constexpr int reap_interval_ms = 1000;
+constexpr std::array<std::string_view, operations> operation_names = {
+    "compress", "decompress"};
+
+struct Job {
+    Protocol::Operation operation;
+    std::vector<uint8_t> in;
+    std::vector<uint8_t> out;
+    std::string error;  // empty when the operation succeeded
+    bool done = false;
+};
+
+// of one operation since the server started
+struct Totals {
+    std::size_t requests = 0;
+    std::size_t errors = 0;
+    std::size_t bytes_in = 0;
+    std::size_t bytes_out = 0;
+    Histogram latency;  // from the request's payload to the response ready
+};
+
+struct State {
+    const Server::Options &options_;
+    int listener_;
+    Bench uptime_;
+    std::mutex mutex_;
+    std::condition_variable queued_;  // on a new job, or once stopping
+    std::condition_variable done_;    // on every finished batch or request
+    std::deque<Job *> jobs_;
+    bool stopping_ = false;
+    std::size_t active_ = 0;  // requests read and not answered yet
+    std::map<int, std::thread> connections_;  // by socket
+    std::vector<int> finished_;  // sockets whose thread is to be joined
+    std::array<Totals, operations> totals_;
+    std::size_t batches_ = 0;
+    std::size_t batched_ = 0;  // jobs run by all batches
+};
+
+std::span<const uint8_t> bytes(const std::string &text) {
+    return {reinterpret_cast<const uint8_t *>(text.data()), text.size()};
+}
+
+void write_histogram(Json &json, const Histogram &histogram) {
+    json.key("p50")
+        .value(histogram.percentile(50))
+        .key("p99")
+        .value(histogram.percentile(99))
+        .key("p999")
+        .value(histogram.percentile(99.9))
+        .key("buckets")
+        .begin_array();
+    for (std::size_t i = 0; i < Histogram::buckets; ++i) {
+        if (histogram.count(i) != 0) {
+            json.begin_object()
+                .key("below")
+                .value(Histogram::upper_bound(i))
+                .key("count")
+                .value(histogram.count(i))
+                .end_object();
+        }
+    }
+    json.end_array();
+}
+
+std::string report(State &state) {
+    HuffmanCoding::TableCache::Stats cache_stats =
+        HuffmanCoding::TableCache::get().stats();
+    std::lock_guard lock(state.mutex_);
+    Json json;
+    json.begin_object()
+        .key("uptime")
+        .value(state.uptime_.elapsed())
+        .key("connections")
+        .value(state.connections_.size() - state.finished_.size())
+        .key("batches")
+        .value(state.batches_)
+        .key("mean_batch")
+        .value(state.batches_ == 0
+                   ? 0.0
+                   : state.batched_ / static_cast<double>(state.batches_));
+    for (std::size_t i = 0; i < operations; ++i) {
+        const Totals &totals = state.totals_[i];
+        json.key(operation_names[i])
+            .begin_object()
+            .key("requests")
+            .value(totals.requests)
+            .key("errors")
+            .value(totals.errors)
+            .key("bytes_in")
+            .value(totals.bytes_in)
+            .key("bytes_out")
+            .value(totals.bytes_out)
+            .key("latency")
+            .begin_object();
+        write_histogram(json, totals.latency);
+        json.end_object().end_object();
+    }
+    json.key("table_cache")
+        .begin_object()
+        .key("hits")
+        .value(cache_stats.hits)
+        .key("misses")
+        .value(cache_stats.misses)
+        .key("evictions")
+        .value(cache_stats.evictions)
+        .key("hit_rate")
+        .value(cache_stats.hit_rate())
+        .end_object();
+    json.end_object();
+    return json.str();
+}
+
+// never throws, as it runs inside OpenMP regions; failures go to job.error
+void run_job(HuffmanCoding::Context &context, Job &job, bool parallel) {
+    try {
+        if (job.operation == Protocol::Operation::compress) {
+            if (parallel) {
+                HuffmanCoding::Parallel::Processor::encode(context, job.in,
+                                                           job.out);
+            } else {
+                HuffmanCoding::Serial::Processor::encode(context, job.in,
+                                                         job.out);
+            }
+        } else {
+            job.error = parallel ? HuffmanCoding::Parallel::Processor::decode(
+                                       context, job.in, job.out)
+                                 : HuffmanCoding::Serial::Processor::decode(
+                                       context, job.in, job.out);
+        }
+    } catch (const std::exception &exception) {
+        job.error = exception.what();
+    }
+    if (!job.error.empty()) {
+        job.out.clear();
+    }
+}
+
+/*
+ * Runs queued jobs until stopping and none is left. A large job runs alone
+ * on the whole team, small ones up to the next large one are batched, each
+ * on one thread with that thread's Context.
+ */
+void dispatch(State &state) {
+    const Server::Options &options = state.options_;
+    int threads = options.processor.threads > 0 ? options.processor.threads
+                                                : omp_get_max_threads();
+    std::vector<HuffmanCoding::Context> contexts(threads);
+    for (HuffmanCoding::Context &context : contexts) {
+        context.options_ = options.processor;
+        context.options_.max_decoded_size = options.max_size;
+    }
+    auto small = [&](const Job *job) {
+        return job->in.size() <= options.small_size;
+    };
+    std::vector<Job *> batch;
+    for (;;) {
+        batch.clear();
+        {
+            std::unique_lock lock(state.mutex_);
+            state.queued_.wait(lock, [&] {
+                return state.stopping_ || !state.jobs_.empty();
+            });
+            if (state.jobs_.empty()) {
+                return;
+            }
+            batch.push_back(state.jobs_.front());
+            state.jobs_.pop_front();
+            while (small(batch[0]) && batch.size() < options.max_batch &&
+                   !state.jobs_.empty() && small(state.jobs_.front())) {
+                batch.push_back(state.jobs_.front());
+                state.jobs_.pop_front();
+            }
+        }
+        if (!small(batch[0])) {
+            run_job(contexts[0], *batch[0], true);
+        } else {
+#pragma omp parallel for if (batch.size() > 1) num_threads(threads) \
+    schedule(dynamic)
+            for (std::size_t i = 0; i < batch.size(); ++i) {
+                run_job(contexts[omp_get_thread_num()], *batch[i], false);
+            }
+        }
+        {
+            std::lock_guard lock(state.mutex_);
+            for (Job *job : batch) {
+                job->done = true;
+            }
+            ++state.batches_;
+            state.batched_ += batch.size();
+        }
+        state.done_.notify_all();
+    }
+}
+
+// queues job and waits for it, false once the server is stopping
+bool submit(State &state, Job &job) {
+    std::unique_lock lock(state.mutex_);
+    if (state.stopping_) {
+        return false;
+    }
+    state.jobs_.push_back(&job);
+    state.queued_.notify_one();
+    state.done_.wait(lock, [&] { return job.done; });
+    return true;
+}
+
+void stop(State &state) {
+    {
+        std::lock_guard lock(state.mutex_);
+        state.stopping_ = true;
+    }
+    state.queued_.notify_all();
+}
+
+// answers one request, false when the connection is to be closed
+bool serve_request(State &state, int socket, const Protocol::Frame &request,
+                   int fd) {
+    Protocol::Frame response = request;
+    response.size = 0;
+    if (request.operation == Protocol::Operation::shutdown ||
+        request.operation == Protocol::Operation::stats) {
+        if (fd != -1) {
+            close(fd);
+        }
+        response.descriptor = 0;
+        if (request.operation == Protocol::Operation::shutdown) {
+            // answered first, the socket is shut down once stopped
+            Protocol::send_frame(socket, response);
+            stop(state);
+            return false;
+        }
+        return Protocol::send_payload(socket, response, bytes(report(state)));
+    }
+    if (request.operation != Protocol::Operation::compress &&
+        request.operation != Protocol::Operation::decompress) {
+        // the payload cannot be skipped without knowing the operation
+        if (fd != -1) {
+            close(fd);
+        }
+        response.status = Protocol::Status::error;
+        response.descriptor = 0;
+        Protocol::send_payload(socket, response, bytes("unknown operation"));
+        return false;
+    }
+
+    if (request.size > state.options_.max_size) {
+        response.status = Protocol::Status::error;
+        response.descriptor = 0;
+        return Protocol::skip_payload(socket, request, fd) &&
+               Protocol::send_payload(
+                   socket, response,
+                   bytes(std::format(
+                       "payload of {} bytes exceeds the limit of {}",
+                       request.size, state.options_.max_size)));
+    }
+
+    Bench bench;
+    Job job{.operation = request.operation};
+    if (!Protocol::receive_payload(socket, request, fd, job.in)) {
+        return false;
+    }
+    if (!submit(state, job)) {
+        job.error = "shutting down";
+    }
+    {
+        // counted before answering, so a stats request right after sees it
+        std::lock_guard lock(state.mutex_);
+        Totals &totals =
+            state.totals_[request.operation == Protocol::Operation::compress
+                              ? 0
+                              : 1];
+        ++totals.requests;
+        totals.errors += !job.error.empty();
+        totals.bytes_in += job.in.size();
+        totals.bytes_out += job.out.size();
+        totals.latency.add(bench.elapsed());
+    }
+    if (job.error.empty()) {
+        return Protocol::send_payload(socket, response, job.out);
+    }
+    response.status = Protocol::Status::error;
+    response.descriptor = 0;
+    return Protocol::send_payload(socket, response, bytes(job.error));
+}
+
+// answers requests until the client leaves or the socket is shut down
+void serve(State &state, int socket) {
+    for (;;) {
+        Protocol::Frame request;
+        int fd;
+        if (!Protocol::receive_frame(socket, request, fd)) {
+            break;
+        }
+        {
+            std::lock_guard lock(state.mutex_);
+            ++state.active_;
+        }
+        bool open = serve_request(state, socket, request, fd);
+        {
+            std::lock_guard lock(state.mutex_);
+            --state.active_;
+        }
+        state.done_.notify_all();
+        if (!open) {
+            break;
+        }
+    }
+    // the client sees EOF now, the socket is closed once the thread is
+    // joined
+    shutdown(socket, SHUT_RDWR);
+    std::lock_guard lock(state.mutex_);
+    state.finished_.push_back(socket);
+}
+
+// joins the threads of connections that ended, and closes their sockets
+void join_finished(State &state) {
+    std::vector<std::thread> threads;
+    std::vector<int> sockets;
+    {
+        std::lock_guard lock(state.mutex_);
+        for (int socket : state.finished_) {
+            threads.push_back(std::move(state.connections_[socket]));
+            state.connections_.erase(socket);
+            sockets.push_back(socket);
+        }
+        state.finished_.clear();
+    }
+    for (std::size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+        close(sockets[i]);
+    }
+}
+
+void accept_connections(State &state) {
+    for (;;) {
+        // wakes up now and then to reap connections while none arrive
+        pollfd listener = {.fd = state.listener_, .events = POLLIN};
+        int ready = poll(&listener, 1, reap_interval_ms);
+        join_finished(state);
+        if (ready == 0 || (ready == -1 && errno == EINTR)) {
+            continue;
+        }
+        int socket = accept4(state.listener_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (socket == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;  // shut down
+        }
+        std::lock_guard lock(state.mutex_);
+        if (state.stopping_) {
+            close(socket);
+            return;
+        }
+        state.connections_.emplace(
+            socket, std::thread(serve, std::ref(state), socket));
+    }
+}
+
+}  // namespace
+
+std::string Server::run(const Options &options) {
+    sockaddr_un address;
+    if (!Protocol::address(options.socket_path, address)) {
+        return std::format("{} is too long for a socket path",
+                           options.socket_path);
+    }
+    // a socket left by a server that died is replaced, a live one is not
+    int client = Protocol::connect(options.socket_path);
+    if (client != -1) {
+        close(client);
+        return std::format("{} is already being served", options.socket_path);
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(options.socket_path.c_str());
+    if (listener == -1 ||
+        bind(listener, reinterpret_cast<sockaddr *>(&address),
+             sizeof(address)) == -1 ||
+        listen(listener, SOMAXCONN) == -1) {
+        std::string error = strerror(errno);
+        if (listener != -1) {
+            close(listener);
+        }
+        return error;
+    }
+
+    State state{.options_ = options, .listener_ = listener};
+    std::thread acceptor(accept_connections, std::ref(state));
+    dispatch(state);
+    // once every request read is answered, connections only wait on their
+    // clients and can be cut
+    shutdown(listener, SHUT_RDWR);
+    {
+        std::unique_lock lock(state.mutex_);
+        state.done_.wait(lock, [&] { return state.active_ == 0; });
+        for (auto &[socket, thread] : state.connections_) {
+            shutdown(socket, SHUT_RDWR);
+        }
+    }
+    acceptor.join();
+    for (auto &[socket, thread] : state.connections_) {
+        thread.join();
+        close(socket);
+    }
+    close(listener);
+    unlink(options.socket_path.c_str());
+    return "";
+}
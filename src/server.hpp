@@ -0,0 +1,34 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <cstddef>
+#include <string>
+
+#include "huffman_coding.hpp"
+
+/**
+ * Daemon compressing and decompressing payloads sent over a Unix socket, in
+ * the framing of Protocol. Connections get a thread each that only moves
+ * bytes; the coding itself is done by a single dispatcher, which keeps one
+ * OpenMP team and a Context per thread warm across requests. Small requests
+ * queued together run as one batch, a request per thread, and large ones
+ * run alone on the whole team.
+ */
+class Server {
+   public:
+    struct Options {
+        std::string socket_path;
+        HuffmanCoding::Options processor;  // of every request
+        // requests of at most this many bytes are batched
+        std::size_t small_size = 1 << 20;
+        std::size_t max_batch = 64;  // requests per batch
+        // bytes of a request's payload, and of what a decompress decodes to
+        std::size_t max_size = std::size_t{1} << 30;
+    };
+
+    // serves until a shutdown request, returns why it could not start,
+    // empty otherwise
+    static std::string run(const Options &options);
+};
+
+#endif
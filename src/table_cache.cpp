@@ -0,0 +1,115 @@
+#include "table_cache.hpp"
+
+#include "utils/hash.hpp"
+
+namespace HuffmanCoding {
+
+namespace {
+
+// never 0, which marks an empty way
+uint64_t hash(const std::array<uint8_t, 256> &code_lengths, Layout layout) {
+    return (xxhash64(code_lengths.data(), code_lengths.size()) ^
+            static_cast<uint64_t>(layout) << 1) |
+           1;
+}
+
+}  // namespace
+
+double TableCache::Stats::hit_rate() const {
+    std::size_t lookups = hits + misses;
+    return lookups == 0 ? 0 : hits / static_cast<double>(lookups);
+}
+
+TableCache::Stats TableCache::Stats::operator-(const Stats &other) const {
+    return {
+        .hits = hits - other.hits,
+        .misses = misses - other.misses,
+        .evictions = evictions - other.evictions,
+    };
+}
+
+TableCache &TableCache::get() {
+    static TableCache cache;
+    return cache;
+}
+
+std::array<TableCache::Way, TableCache::ways> &TableCache::set(uint64_t key) {
+    return ways_[key >> (64 - std::countr_zero(sets))];
+}
+
+/*
+ * The key is checked before the tables are loaded, and the lengths after,
+ * so a way being replaced meanwhile reads as a miss
+ */
+std::shared_ptr<const Tables> TableCache::lookup(
+    uint64_t key, const std::array<uint8_t, 256> &code_lengths,
+    Layout layout) {
+    for (Way &way : set(key)) {
+        if (way.key_.load(std::memory_order_acquire) != key) {
+            continue;
+        }
+        std::shared_ptr<const Tables> tables = way.tables_.load();
+        if (tables && tables->code_lengths == code_lengths &&
+            tables->layout == layout) {
+            // stamped with the clock inserts advance, and only once it
+            // moved, so hits in between only read the way
+            uint64_t now = clock_.load(std::memory_order_relaxed);
+            if (way.used_.load(std::memory_order_relaxed) != now) {
+                way.used_.store(now, std::memory_order_relaxed);
+            }
+            return tables;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const Tables> TableCache::find(
+    const std::array<uint8_t, 256> &code_lengths, Layout layout) {
+    std::shared_ptr<const Tables> tables =
+        lookup(hash(code_lengths, layout), code_lengths, layout);
+    (tables ? hits_ : misses_).fetch_add(1, std::memory_order_relaxed);
+    return tables;
+}
+
+std::shared_ptr<const Tables> TableCache::insert(
+    std::shared_ptr<const Tables> tables) {
+    uint64_t key = hash(tables->code_lengths, tables->layout);
+    std::lock_guard lock(insert_);
+    if (std::shared_ptr<const Tables> cached =
+            lookup(key, tables->code_lengths, tables->layout)) {
+        return cached;
+    }
+    std::array<Way, ways> &candidates = set(key);
+    Way *victim = &candidates[0];
+    for (Way &way : candidates) {
+        if (way.key_.load(std::memory_order_relaxed) == 0) {
+            victim = &way;
+            break;
+        }
+        if (way.used_.load(std::memory_order_relaxed) <
+            victim->used_.load(std::memory_order_relaxed)) {
+            victim = &way;
+        }
+    }
+    if (victim->key_.load(std::memory_order_relaxed) != 0) {
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+    // readers that still match the old key see new lengths and miss
+    victim->key_.store(0, std::memory_order_release);
+    victim->tables_.store(tables);
+    uint64_t now = clock_.load(std::memory_order_relaxed) + 1;
+    clock_.store(now, std::memory_order_relaxed);
+    victim->used_.store(now, std::memory_order_relaxed);
+    victim->key_.store(key, std::memory_order_release);
+    return tables;
+}
+
+TableCache::Stats TableCache::stats() const {
+    return {
+        .hits = hits_.load(std::memory_order_relaxed),
+        .misses = misses_.load(std::memory_order_relaxed),
+        .evictions = evictions_.load(std::memory_order_relaxed),
+    };
+}
+
+}  // namespace HuffmanCoding
@@ -0,0 +1,84 @@
+#ifndef TABLE_CACHE_HPP
+#define TABLE_CACHE_HPP
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "kernels.hpp"
+
+namespace HuffmanCoding {
+
+/**
+ * Encode and decode tables of one vector of code lengths in one layout,
+ * immutable once built so threads and calls can share them
+ */
+struct Tables {
+    std::array<uint8_t, 256> code_lengths = {0};
+    Layout layout = Layout::msb_first;
+    EncodeTable encode;
+    DecodeTable decode;
+};
+
+/**
+ * Process-wide cache of built Tables keyed by their code lengths and
+ * layout. Sets of ways are picked by a hash of both; lookups take no lock
+ * of the cache's own, though loading an atomic shared_ptr takes a short
+ * one inside libstdc++. Inserts lock and evict the least recently used way
+ * of the set, recency counted in inserts, as hits never advance the clock.
+ */
+class TableCache {
+   public:
+    struct Stats {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t evictions = 0;
+
+        double hit_rate() const;
+        Stats operator-(const Stats &other) const;
+    };
+
+   private:
+    static constexpr std::size_t sets = 16;
+    static constexpr std::size_t ways = 4;
+    static_assert(std::has_single_bit(sets));
+
+    struct Way {
+        std::atomic<uint64_t> key_ = 0;   // hash of the key, 0 if empty
+        std::atomic<uint64_t> used_ = 0;  // clock_ at the last hit
+        std::atomic<std::shared_ptr<const Tables>> tables_;
+    };
+
+    std::array<std::array<Way, ways>, sets> ways_;
+    std::atomic<uint64_t> clock_ = 0;  // inserts so far, only they write it
+    std::mutex insert_;
+    std::atomic<std::size_t> hits_ = 0;
+    std::atomic<std::size_t> misses_ = 0;
+    std::atomic<std::size_t> evictions_ = 0;
+
+    TableCache() = default;
+    // picked by the top bits of key, as its lowest bit is always set
+    std::array<Way, ways> &set(uint64_t key);
+    // the way holding code_lengths in layout, if any
+    std::shared_ptr<const Tables> lookup(
+        uint64_t key, const std::array<uint8_t, 256> &code_lengths,
+        Layout layout);
+
+   public:
+    static TableCache &get();
+    // nullptr on a miss
+    std::shared_ptr<const Tables> find(
+        const std::array<uint8_t, 256> &code_lengths, Layout layout);
+    // keeps tables unless an equal entry was inserted meanwhile, returns
+    // the one cached
+    std::shared_ptr<const Tables> insert(std::shared_ptr<const Tables> tables);
+    Stats stats() const;
+};
+
+}  // namespace HuffmanCoding
+
+#endif
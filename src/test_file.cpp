@@ -1,35 +1,414 @@
 #include "test_file.hpp"
 
-#include <sys/mman.h>
-
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <cstring>
-#include <fstream>
-#include <iostream>
-#include <random>
+#include <ctime>
 #include <string>
+#include <unordered_set>
+#include <vector>
 
-#include "utils/bench.hpp"
 #include "utils/byte_stream.hpp"
-#include "utils/print.hpp"
-#include "utils/sizes.hpp"
 
-void TestFile::generate(std::string pathname, std::size_t size) {
-    OByteStream obs(pathname, size);
-    uint8_t *obs_map = obs.map();
+namespace {
+
+constexpr std::size_t chunk_size = 1 << 20;    // unit of parallel generation
+constexpr std::size_t section_size = 1 << 16;  // unit of the mixed corpus
+
+uint64_t splitmix64(uint64_t &state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+/**
+ * xoshiro256**, used instead of <random> so that the output does not depend
+ * on the standard library implementation
+ */
+class Rng {
+    uint64_t s_[4];
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+   public:
+    explicit Rng(uint64_t seed) {
+        for (uint64_t &s : s_) {
+            s = splitmix64(seed);
+        }
+    }
+
+    uint64_t operator()() {
+        uint64_t result = rotl(s_[1] * 5, 7) * 9;
+        uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl(s_[3], 45);
+        return result;
+    }
+
+    // [0, 1)
+    double uniform() { return ((*this)() >> 11) * 0x1.0p-53; }
+
+    // [0, n)
+    uint64_t below(uint64_t n) {
+        return static_cast<uint64_t>(
+            (static_cast<unsigned __int128>((*this)()) * n) >> 64);
+    }
+};
+
+/**
+ * Vose alias table for O(1) sampling from a fixed discrete distribution
+ */
+class Alias {
+    std::vector<double> probability_;
+    std::vector<uint32_t> alias_;
+
+   public:
+    explicit Alias(const std::vector<double> &weights)
+        : probability_(weights.size()), alias_(weights.size()) {
+        double total = 0;
+        for (double weight : weights) {
+            total += weight;
+        }
+        std::vector<double> scaled(weights.size());
+        std::vector<uint32_t> small;
+        std::vector<uint32_t> large;
+        for (std::size_t i = 0; i < weights.size(); ++i) {
+            scaled[i] = weights[i] * weights.size() / total;
+            (scaled[i] < 1 ? small : large).push_back(i);
+        }
+        while (!small.empty() && !large.empty()) {
+            uint32_t s = small.back();
+            uint32_t l = large.back();
+            small.pop_back();
+            large.pop_back();
+            probability_[s] = scaled[s];
+            alias_[s] = l;
+            scaled[l] += scaled[s] - 1;
+            (scaled[l] < 1 ? small : large).push_back(l);
+        }
+        for (uint32_t i : small) {
+            probability_[i] = 1;
+        }
+        for (uint32_t i : large) {
+            probability_[i] = 1;
+        }
+    }
+
+    uint32_t operator()(Rng &rng) const {
+        uint32_t i = rng.below(probability_.size());
+        return rng.uniform() < probability_[i] ? i : alias_[i];
+    }
+};
+
+/**
+ * Words ranked so that the most frequent ones are the shortest
+ */
+class Vocabulary {
+    std::vector<std::string> words_;
+    Alias ranks_;
 
-    std::random_device rd;
-    std::mt19937_64 gen(rd());
-    std::poisson_distribution<uint64_t> dis(6);
-    for (std::size_t i = 0; i < obs.size() / 8; ++i) {
-        uint64_t val = dis(gen);
-        std::memcpy(obs_map + 8 * i, &val, 8);
+    static std::vector<double> zipf_weights(std::size_t size) {
+        std::vector<double> weights(size);
+        for (std::size_t i = 0; i < size; ++i) {
+            weights[i] = 1 / std::pow(i + 1, 1.1);
+        }
+        return weights;
     }
-    {
-        std::mt19937_64 gen(rd());
-        std::poisson_distribution<uint64_t> dis(6);
-        uint64_t val = dis(gen);
-        if (obs.size() % 8 != 0) {
-            std::memcpy(obs_map + obs.size() / 8, &val, obs.size() % 8);
+
+   public:
+    static constexpr std::size_t size = 4096;
+
+    explicit Vocabulary(uint64_t seed) : ranks_(zipf_weights(size)) {
+        // English letter and word length frequencies
+        Alias letters({8.2, 1.5, 2.8, 4.3, 12.7, 2.2, 2.0, 6.1, 7.0,
+                       0.2, 0.8, 4.0, 2.4, 6.7, 7.5, 1.9, 0.1, 6.0,
+                       6.3, 9.1, 2.8, 1.0, 2.4, 0.2, 2.0, 0.1});
+        Alias lengths({3, 17, 21, 16, 11, 9, 8, 6, 4, 3, 2});
+        Rng rng(seed);
+        std::unordered_set<std::string> unique;
+        while (words_.size() < size) {
+            std::string word;
+            std::size_t length = 1 + lengths(rng);
+            for (std::size_t i = 0; i < length; ++i) {
+                word += static_cast<char>('a' + letters(rng));
+            }
+            if (unique.insert(word).second) {
+                words_.push_back(std::move(word));
+            }
         }
+        std::stable_sort(words_.begin(), words_.end(),
+                         [](const std::string &lhs, const std::string &rhs) {
+                             return lhs.size() < rhs.size();
+                         });
+    }
+
+    const std::string &operator()(Rng &rng) const {
+        return words_[ranks_(rng)];
+    }
+};
+
+struct Context {
+    Vocabulary vocabulary;
+};
+
+/**
+ * Bounded writer that silently truncates the last token of a chunk
+ */
+class Writer {
+    uint8_t *out_;
+    std::size_t size_;
+    std::size_t i_ = 0;
+
+   public:
+    Writer(uint8_t *out, std::size_t size) : out_(out), size_(size) {}
+
+    bool full() const { return i_ == size_; }
+
+    void put(uint8_t value) {
+        if (i_ < size_) {
+            out_[i_++] = value;
+        }
+    }
+
+    void put(const void *data, std::size_t size) {
+        size = std::min(size, size_ - i_);
+        std::memcpy(out_ + i_, data, size);
+        i_ += size;
+    }
+
+    void put(std::string_view s) { put(s.data(), s.size()); }
+};
+
+void fill(TestFile::Corpus corpus, Rng &rng, const Context &context,
+          std::size_t chunk, uint8_t *out, std::size_t size);
+
+// uint64 counts of a Poisson(6) process
+void fill_poisson(Rng &rng, Writer &writer) {
+    const double limit = std::exp(-6.0);
+    while (!writer.full()) {
+        uint64_t k = 0;
+        for (double p = rng.uniform(); p > limit; p *= rng.uniform()) {
+            ++k;
+        }
+        writer.put(&k, 8);
+    }
+}
+
+void fill_zipf(Rng &rng, const Context &context, Writer &writer) {
+    std::size_t words = 0;
+    while (!writer.full()) {
+        writer.put(context.vocabulary(rng));
+        ++words;
+        uint64_t r = rng.below(100);
+        if (r < 6) {
+            writer.put(words > 8 ? std::string_view(".\n")
+                                 : std::string_view(". "));
+            words = words > 8 ? 0 : words;
+        } else if (r < 12) {
+            writer.put(std::string_view(", "));
+        } else {
+            writer.put(' ');
+        }
+    }
+}
+
+void fill_logs(Rng &rng, std::size_t chunk, Writer &writer) {
+    static constexpr std::string_view levels[] = {"DEBUG", "INFO", "WARN",
+                                                  "ERROR"};
+    static const Alias level_weights({20, 70, 8, 2});
+    static constexpr std::string_view components[] = {
+        "http", "db", "cache", "auth", "scheduler", "worker"};
+    static constexpr std::string_view methods[] = {"GET", "POST", "PUT",
+                                                   "DELETE"};
+    static constexpr std::string_view resources[] = {"users", "orders",
+                                                     "items", "sessions"};
+
+    // each chunk covers its own minute so timestamps stay monotonic
+    uint64_t ms = 1700000000000 + chunk * 60000;
+    char line[256];
+    while (!writer.full()) {
+        ms += rng.below(8);
+        std::time_t seconds = ms / 1000;
+        std::tm tm;
+        gmtime_r(&seconds, &tm);
+        int n = std::snprintf(
+            line, sizeof(line),
+            "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ %-5s [%s] ",
+            tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour,
+            tm.tm_min, tm.tm_sec, static_cast<int>(ms % 1000),
+            levels[level_weights(rng)].data(),
+            components[rng.below(6)].data());
+        switch (rng.below(5)) {
+            case 0: {
+                n += std::snprintf(
+                    line + n, sizeof(line) - n,
+                    "request completed method=%s path=/api/v1/%s/%u "
+                    "status=%u duration_ms=%u\n",
+                    methods[rng.below(4)].data(),
+                    resources[rng.below(4)].data(),
+                    static_cast<unsigned>(rng.below(100000)),
+                    rng.below(10) == 0 ? 500u : 200u,
+                    static_cast<unsigned>(rng.below(250)));
+                break;
+            }
+            case 1: {
+                n += std::snprintf(
+                    line + n, sizeof(line) - n,
+                    "connection from 10.%u.%u.%u:%u accepted\n",
+                    static_cast<unsigned>(rng.below(4)),
+                    static_cast<unsigned>(rng.below(256)),
+                    static_cast<unsigned>(rng.below(256)),
+                    static_cast<unsigned>(32768 + rng.below(28232)));
+                break;
+            }
+            case 2: {
+                n += std::snprintf(line + n, sizeof(line) - n,
+                                   "cache miss key=%s:%08x\n",
+                                   resources[rng.below(4)].data(),
+                                   static_cast<unsigned>(rng()));
+                break;
+            }
+            case 3: {
+                n += std::snprintf(line + n, sizeof(line) - n,
+                                   "retrying upstream=%s attempt=%u "
+                                   "backoff_ms=%u\n",
+                                   components[rng.below(6)].data(),
+                                   static_cast<unsigned>(1 + rng.below(5)),
+                                   static_cast<unsigned>(100 << rng.below(6)));
+                break;
+            }
+            case 4: {
+                n += std::snprintf(
+                    line + n, sizeof(line) - n,
+                    "user %u logged in session=%016llx\n",
+                    static_cast<unsigned>(rng.below(1000000)),
+                    static_cast<unsigned long long>(rng()));
+                break;
+            }
+        }
+        writer.put(line, n);
+    }
+}
+
+void fill_uniform(Rng &rng, Writer &writer) {
+    while (!writer.full()) {
+        uint64_t value = rng();
+        writer.put(&value, 8);
+    }
+}
+
+// little-endian records of doubles, small integers and raw bytes
+void fill_binary(Rng &rng, Writer &writer) {
+    while (!writer.full()) {
+        uint64_t r = rng.below(10);
+        if (r < 5) {
+            double value = (rng.uniform() + rng.uniform() + rng.uniform() +
+                            rng.uniform() - 2) *
+                           1000;
+            writer.put(&value, 8);
+        } else if (r < 8) {
+            uint32_t value = rng.below(1 << 16);
+            writer.put(&value, 4);
+        } else {
+            uint64_t value[2] = {rng(), rng()};
+            writer.put(value, 16);
+        }
+    }
+}
+
+void fill_runs(Rng &rng, Writer &writer) {
+    while (!writer.full()) {
+        uint8_t value = rng.below(16) * 17;
+        std::size_t length = rng.below(20) == 0
+                                 ? 1024 + rng.below(7168)
+                                 : 1 + static_cast<std::size_t>(
+                                           -32 * std::log(1 - rng.uniform()));
+        for (std::size_t i = 0; i < length; ++i) {
+            writer.put(value);
+        }
+    }
+}
+
+void fill_mixed(Rng &rng, const Context &context, std::size_t chunk,
+                uint8_t *out, std::size_t size) {
+    for (std::size_t i = 0; i < size; i += section_size) {
+        auto corpus = static_cast<TestFile::Corpus>(
+            rng.below(TestFile::corpora - 1));  // anything but mixed
+        fill(corpus, rng, context, chunk, out + i,
+             std::min(section_size, size - i));
+    }
+}
+
+void fill(TestFile::Corpus corpus, Rng &rng, const Context &context,
+          std::size_t chunk, uint8_t *out, std::size_t size) {
+    Writer writer(out, size);
+    switch (corpus) {
+        case TestFile::Corpus::poisson: {
+            fill_poisson(rng, writer);
+            break;
+        }
+        case TestFile::Corpus::zipf: {
+            fill_zipf(rng, context, writer);
+            break;
+        }
+        case TestFile::Corpus::logs: {
+            fill_logs(rng, chunk, writer);
+            break;
+        }
+        case TestFile::Corpus::uniform: {
+            fill_uniform(rng, writer);
+            break;
+        }
+        case TestFile::Corpus::binary: {
+            fill_binary(rng, writer);
+            break;
+        }
+        case TestFile::Corpus::runs: {
+            fill_runs(rng, writer);
+            break;
+        }
+        case TestFile::Corpus::mixed: {
+            fill_mixed(rng, context, chunk, out, size);
+            break;
+        }
+    }
+}
+
+}  // namespace
+
+std::optional<TestFile::Corpus> TestFile::parse(std::string_view name) {
+    for (std::size_t i = 0; i < corpora; ++i) {
+        if (corpus_names[i] == name) {
+            return static_cast<Corpus>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+void TestFile::generate(std::string pathname, std::size_t size, Corpus corpus,
+                        uint64_t seed) {
+    OByteStream obs(pathname, size);
+    uint8_t *obs_map = obs.map();
+
+    const Context context = {.vocabulary = Vocabulary(seed)};
+    std::size_t chunks = (size + chunk_size - 1) / chunk_size;
+#pragma omp parallel for schedule(dynamic)
+    for (std::size_t i = 0; i < chunks; ++i) {
+        // every chunk has its own stream derived from (seed, corpus, chunk)
+        uint64_t state = seed ^ (static_cast<uint64_t>(corpus) << 56);
+        splitmix64(state);
+        state ^= i;
+        Rng rng(splitmix64(state));
+        std::size_t begin = i * chunk_size;
+        fill(corpus, rng, context, i, obs_map + begin,
+             std::min(chunk_size, size - begin));
     }
 }
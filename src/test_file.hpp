@@ -1,14 +1,29 @@
 #ifndef TEST_FILE_HPP
 #define TEST_FILE_HPP
 
+#include <array>
 #include <cstddef>
+#include <cstdint>
+#include <optional>
 #include <string>
+#include <string_view>
 
 #include "utils/byte_stream.hpp"
 
 class TestFile {
    public:
-    static void generate(std::string pathname, std::size_t size);
+    enum class Corpus { poisson, zipf, logs, uniform, binary, runs, mixed };
+    static constexpr std::size_t corpora = 7;
+    static constexpr std::array<std::string_view, corpora> corpus_names = {
+        "poisson", "zipf", "logs", "uniform", "binary", "runs", "mixed"};
+    static constexpr uint64_t default_seed = 0x5107;
+
+    static std::optional<Corpus> parse(std::string_view name);
+    // same (corpus, size, seed) always produces the same bytes, regardless
+    // of the number of threads
+    static void generate(std::string pathname, std::size_t size,
+                         Corpus corpus = Corpus::poisson,
+                         uint64_t seed = default_seed);
 };
 
 #endif
@@ -0,0 +1,124 @@
+#include "affinity.hpp"
+
+#include <omp.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cctype>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace {
+
+std::atomic<bool> pinned = false;
+
+// "0-3,8-11" into its CPUs
+std::vector<int> parse_cpulist(const std::string &list) {
+    std::vector<int> cpus;
+    for (std::size_t i = 0; i < list.size();) {
+        std::size_t end = list.find(',', i);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string range = list.substr(i, end - i);
+        std::size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = first;
+        if (dash != std::string::npos) {
+            last = std::stoi(range.substr(dash + 1));
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+        i = end + 1;
+    }
+    return cpus;
+}
+
+}  // namespace
+
+Topology::Topology() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+
+    std::vector<std::pair<int, std::vector<int>>> nodes;
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator(
+             "/sys/devices/system/node", error)) {
+        std::string name = entry.path().filename();
+        if (name.size() <= 4 || name.rfind("node", 0) != 0 ||
+            !std::all_of(name.begin() + 4, name.end(), ::isdigit)) {
+            continue;
+        }
+        std::ifstream file(entry.path() / "cpulist");
+        std::string list;
+        std::getline(file, list);
+        std::vector<int> cpus;
+        for (int cpu : parse_cpulist(list)) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                cpus.push_back(cpu);
+            }
+        }
+        if (!cpus.empty()) {
+            nodes.emplace_back(std::stoi(name.substr(4)), cpus);
+        }
+    }
+    std::sort(nodes.begin(), nodes.end());
+    for (auto &[node, cpus] : nodes) {
+        nodes_.push_back(std::move(cpus));
+    }
+    if (nodes_.empty()) {
+        nodes_.emplace_back();
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                nodes_.back().push_back(cpu);
+            }
+        }
+    }
+    for (const std::vector<int> &cpus : nodes_) {
+        cpus_.insert(cpus_.end(), cpus.begin(), cpus.end());
+    }
+}
+
+const Topology &Topology::get() {
+    static Topology topology;
+    return topology;
+}
+
+std::size_t Topology::nodes() const { return nodes_.size(); }
+
+const std::vector<int> &Topology::cpus(std::size_t node) const {
+    return nodes_[node];
+}
+
+const std::vector<int> &Topology::cpus() const { return cpus_; }
+
+void place_threads(int threads, bool pin) {
+    if (!pin && !pinned) {
+        return;
+    }
+    const std::vector<int> &cpus = Topology::get().cpus();
+#pragma omp parallel num_threads(threads)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (pin) {
+            CPU_SET(cpus[omp_get_thread_num() % cpus.size()], &set);
+        } else {
+            for (int cpu : cpus) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+    pinned = pin;
+}
+
+void place_threads(int threads, const cpu_set_t &set) {
+#pragma omp parallel num_threads(threads)
+    sched_setaffinity(0, sizeof(set), &set);
+    pinned = false;
+}
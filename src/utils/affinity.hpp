@@ -0,0 +1,40 @@
+#ifndef AFFINITY_HPP
+#define AFFINITY_HPP
+
+#include <sched.h>
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * CPUs this process may run on, grouped by NUMA node, read once from
+ * /sys/devices/system/node. Without it every CPU is on node 0.
+ */
+class Topology {
+    std::vector<std::vector<int>> nodes_;
+    std::vector<int> cpus_;  // node after node
+
+    Topology();
+
+   public:
+    static const Topology &get();
+    std::size_t nodes() const;
+    const std::vector<int> &cpus(std::size_t node) const;
+    const std::vector<int> &cpus() const;
+};
+
+/*
+ * Pins thread i of OpenMP teams of threads to the i-th CPU, filling one node
+ * before the next, or lets every thread run anywhere again when pin is
+ * false. The calling thread is thread 0. libgomp keeps its workers, so the
+ * placement holds for the following regions of the same size.
+ */
+void place_threads(int threads, bool pin);
+
+/*
+ * Lets every thread of OpenMP teams of threads run on the CPUs of set, as
+ * saved by sched_getaffinity before pinning them.
+ */
+void place_threads(int threads, const cpu_set_t &set);
+
+#endif
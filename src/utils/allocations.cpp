@@ -0,0 +1,49 @@
+#include "allocations.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef COUNT_ALLOCATIONS
+
+namespace {
+
+std::atomic<std::size_t> count = 0;
+
+}  // namespace
+
+std::optional<std::size_t> allocations() {
+    return count.load(std::memory_order_relaxed);
+}
+
+// the array and nothrow forms forward to these
+void *operator new(std::size_t size) {
+    count.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    count.fetch_add(1, std::memory_order_relaxed);
+    std::size_t align = static_cast<std::size_t>(alignment);
+    // aligned_alloc wants a nonzero multiple of the alignment
+    std::size_t rounded =
+        (std::max<std::size_t>(size, 1) + align - 1) / align * align;
+    if (void *p = std::aligned_alloc(align, rounded)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+
+#else
+
+std::optional<std::size_t> allocations() { return std::nullopt; }
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef ALLOCATIONS_HPP
+#define ALLOCATIONS_HPP
+
+#include <cstddef>
+#include <optional>
+
+/**
+ * Heap allocations made by the process so far, counted by replacing the
+ * global operator new when built with COUNT_ALLOCATIONS, as the bench binary
+ * is; empty otherwise. Differences around a call tell whether it allocated.
+ */
+std::optional<std::size_t> allocations();
+
+#endif
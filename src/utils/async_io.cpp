@@ -0,0 +1,139 @@
+#include "async_io.hpp"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <exception>
+#include <utility>
+
+/**
+ * Task
+ */
+
+Task Task::promise_type::get_return_object() {
+    return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+}
+
+void Task::promise_type::unhandled_exception() { std::terminate(); }
+
+Task::Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+Task::Task(Task &&other) noexcept
+    : handle_(std::exchange(other.handle_, nullptr)) {}
+
+Task &Task::operator=(Task &&other) noexcept {
+    if (this != &other) {
+        if (handle_) {
+            handle_.destroy();
+        }
+        handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+}
+
+Task::~Task() {
+    if (handle_) {
+        handle_.destroy();
+    }
+}
+
+bool Task::done() const { return !handle_ || handle_.done(); }
+
+/**
+ * IoQueue
+ */
+
+void IoQueue::Operation::await_suspend(std::coroutine_handle<> waiter) {
+    waiter_ = waiter;
+    queue_->submit(this);
+}
+
+IoQueue::IoQueue(std::size_t threads) {
+    for (std::size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back(&IoQueue::work, this);
+    }
+}
+
+IoQueue::~IoQueue() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    submitted_.notify_all();
+    for (std::thread &thread : threads_) {
+        thread.join();
+    }
+}
+
+IoQueue::Operation IoQueue::read(int fd, uint8_t *data, std::size_t size,
+                                 std::size_t offset) {
+    return {this, false, fd, data, size, offset};
+}
+
+IoQueue::Operation IoQueue::write(int fd, const uint8_t *data,
+                                  std::size_t size, std::size_t offset) {
+    return {this, true, fd, const_cast<uint8_t *>(data), size, offset};
+}
+
+bool IoQueue::run_one() {
+    Operation *operation;
+    {
+        std::unique_lock lock(mutex_);
+        if (in_flight_ == 0) {
+            return false;
+        }
+        completed_.wait(lock, [this] { return !done_.empty(); });
+        operation = done_.front();
+        done_.pop_front();
+        --in_flight_;
+    }
+    operation->waiter_.resume();
+    return true;
+}
+
+void IoQueue::submit(Operation *operation) {
+    {
+        std::lock_guard lock(mutex_);
+        pending_.push_back(operation);
+        ++in_flight_;
+    }
+    submitted_.notify_one();
+}
+
+void IoQueue::work() {
+    for (;;) {
+        Operation *operation;
+        {
+            std::unique_lock lock(mutex_);
+            submitted_.wait(lock,
+                            [this] { return stopping_ || !pending_.empty(); });
+            if (pending_.empty()) {
+                return;
+            }
+            operation = pending_.front();
+            pending_.pop_front();
+        }
+        // short transfers are continued, a read hitting the end is an error
+        for (std::size_t done = 0; done < operation->size_;) {
+            ssize_t result =
+                operation->write_
+                    ? pwrite(operation->fd_, operation->data_ + done,
+                             operation->size_ - done, operation->offset_ + done)
+                    : pread(operation->fd_, operation->data_ + done,
+                            operation->size_ - done, operation->offset_ + done);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                operation->error_ = result == 0 ? EIO : errno;
+                break;
+            }
+            done += result;
+        }
+        {
+            std::lock_guard lock(mutex_);
+            done_.push_back(operation);
+        }
+        completed_.notify_one();
+    }
+}
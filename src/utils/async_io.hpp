@@ -0,0 +1,93 @@
+#ifndef ASYNC_IO_HPP
+#define ASYNC_IO_HPP
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Coroutine started eagerly by calling it, it runs on the caller's thread
+ * until its first co_await and is then resumed by IoQueue::run_one. Its
+ * frame lives until the Task is destroyed or assigned over.
+ */
+class Task {
+   public:
+    struct promise_type {
+        Task get_return_object();
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception();
+    };
+
+    Task() = default;
+    Task(Task &&other) noexcept;
+    Task &operator=(Task &&other) noexcept;
+    ~Task();
+    // true once the coroutine returned, or for a Task holding none
+    bool done() const;
+
+   private:
+    std::coroutine_handle<promise_type> handle_;
+
+    explicit Task(std::coroutine_handle<promise_type> handle);
+};
+
+/**
+ * Positional reads and writes of whole ranges, completed by a few threads
+ * blocking in pread and pwrite so the thread awaiting them keeps computing.
+ * Completed operations queue up until run_one resumes their coroutine on
+ * the thread calling it, which is therefore the only one running coroutine
+ * code.
+ */
+class IoQueue {
+   public:
+    struct Operation;
+
+   private:
+    std::mutex mutex_;
+    std::condition_variable submitted_;
+    std::condition_variable completed_;
+    std::deque<Operation *> pending_;
+    std::deque<Operation *> done_;
+    std::size_t in_flight_ = 0;  // submitted and not yet resumed
+    bool stopping_ = false;
+    std::vector<std::thread> threads_;
+
+    void submit(Operation *operation);
+    void work();
+
+   public:
+    struct Operation {
+        IoQueue *queue_;
+        bool write_;
+        int fd_;
+        uint8_t *data_;
+        std::size_t size_;
+        std::size_t offset_;
+        int error_ = 0;  // errno of the failed call, EIO past the end of file
+        std::coroutine_handle<> waiter_;
+
+        bool await_ready() const { return size_ == 0; }
+        void await_suspend(std::coroutine_handle<> waiter);
+        // 0 or the error
+        int await_resume() const { return error_; }
+    };
+
+    explicit IoQueue(std::size_t threads);
+    ~IoQueue();
+    Operation read(int fd, uint8_t *data, std::size_t size,
+                   std::size_t offset);
+    Operation write(int fd, const uint8_t *data, std::size_t size,
+                    std::size_t offset);
+    // waits for an operation to complete and resumes its coroutine, false
+    // right away when none is in flight
+    bool run_one();
+};
+
+#endif
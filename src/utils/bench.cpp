@@ -1,9 +1,26 @@
 #include "bench.hpp"
 
+#include <linux/perf_event.h>
+#include <omp.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+/**
+ * Bench
+ */
 
 Bench::Bench() : start_(std::chrono::steady_clock::now()) {}
 
+void Bench::reset() { start_ = std::chrono::steady_clock::now(); }
+
 double Bench::elapsed(unit mode) {
     auto end = std::chrono::steady_clock::now();
     switch (mode) {
@@ -33,3 +50,186 @@ std::string Bench::format(unit mode) {
     }
     return "";
 }
+
+/**
+ * Samples
+ */
+
+void Samples::add(double value) { values_.push_back(value); }
+
+std::size_t Samples::size() const { return values_.size(); }
+
+double Samples::min() const {
+    if (values_.empty()) {
+        return 0;
+    }
+    return *std::min_element(values_.begin(), values_.end());
+}
+
+double Samples::max() const {
+    if (values_.empty()) {
+        return 0;
+    }
+    return *std::max_element(values_.begin(), values_.end());
+}
+
+double Samples::mean() const {
+    if (values_.empty()) {
+        return 0;
+    }
+    return std::accumulate(values_.begin(), values_.end(), 0.0) /
+           values_.size();
+}
+
+double Samples::percentile(double p) const {
+    if (values_.empty()) {
+        return 0;
+    }
+    std::vector<double> sorted(values_);
+    std::sort(sorted.begin(), sorted.end());
+    std::size_t rank = static_cast<std::size_t>(
+        std::ceil(p / 100 * static_cast<double>(sorted.size())));
+    return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+}
+
+/**
+ * Histogram
+ */
+
+void Histogram::add(double seconds) {
+    std::size_t bucket = 0;
+    for (double bound = 1e-6; seconds >= bound && bucket + 1 < buckets;
+         bound *= 2) {
+        ++bucket;
+    }
+    ++counts_[bucket];
+    ++size_;
+}
+
+std::size_t Histogram::size() const { return size_; }
+
+double Histogram::upper_bound(std::size_t bucket) {
+    return std::ldexp(1e-6, bucket);
+}
+
+std::size_t Histogram::count(std::size_t bucket) const {
+    return counts_[bucket];
+}
+
+double Histogram::percentile(double p) const {
+    if (size_ == 0) {
+        return 0;
+    }
+    std::size_t rank = std::clamp<std::size_t>(
+        static_cast<std::size_t>(std::ceil(p / 100 * size_)), 1, size_);
+    std::size_t seen = 0;
+    for (std::size_t i = 0; i < buckets; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return upper_bound(i);
+        }
+    }
+    return upper_bound(buckets - 1);
+}
+
+/**
+ * Counters
+ */
+
+namespace {
+
+int open_event(pid_t tid, Counters::event event) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    switch (event) {
+        case Counters::cycles: {
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        }
+        case Counters::instructions: {
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        }
+        case Counters::branch_misses: {
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        }
+        case Counters::llc_misses: {
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_LL |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        }
+        case Counters::page_faults: {
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+            break;
+        }
+    }
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0);
+}
+
+}  // namespace
+
+Counters::Counters() {
+    // worker threads persist across parallel regions, so counting by tid
+    // follows them through every later region with the same team size
+    std::vector<pid_t> tids(omp_get_max_threads(), 0);
+#pragma omp parallel
+    { tids[omp_get_thread_num()] = gettid(); }
+    fds_.resize(tids.size());
+    for (std::size_t i = 0; i < tids.size(); ++i) {
+        for (std::size_t j = 0; j < events; ++j) {
+            fds_[i][j] = open_event(tids[i], static_cast<event>(j));
+        }
+    }
+}
+
+Counters::~Counters() {
+    for (const std::array<int, events> &fds : fds_) {
+        for (int fd : fds) {
+            if (fd != -1) {
+                close(fd);
+            }
+        }
+    }
+}
+
+bool Counters::available() const {
+    return std::any_of(fds_.begin(), fds_.end(),
+                       [](const std::array<int, events> &fds) {
+                           return std::any_of(fds.begin(), fds.end(),
+                                              [](int fd) { return fd != -1; });
+                       });
+}
+
+std::size_t Counters::threads() const { return fds_.size(); }
+
+std::vector<Counters::Values> Counters::read() const {
+    std::vector<Values> values(fds_.size());
+    for (std::size_t i = 0; i < fds_.size(); ++i) {
+        for (std::size_t j = 0; j < events; ++j) {
+            values[i][j] = std::numeric_limits<double>::quiet_NaN();
+            uint64_t buffer[3];  // value, time enabled, time running
+            if (fds_[i][j] == -1 ||
+                ::read(fds_[i][j], buffer, sizeof(buffer)) != sizeof(buffer)) {
+                continue;
+            }
+            // scale up when the PMU was multiplexed between events
+            values[i][j] =
+                buffer[2] == 0
+                    ? 0
+                    : buffer[0] * (static_cast<double>(buffer[1]) / buffer[2]);
+        }
+    }
+    return values;
+}
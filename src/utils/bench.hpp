@@ -1,8 +1,12 @@
 #ifndef BENCH_HPP
 #define BENCH_HPP
 
+#include <array>
 #include <chrono>
+#include <cstddef>
 #include <string>
+#include <string_view>
+#include <vector>
 
 class Bench {
     std::chrono::time_point<std::chrono::steady_clock> start_;
@@ -10,8 +14,75 @@ class Bench {
    public:
     enum unit { s, ns };
     Bench();
+    void reset();
     double elapsed(unit mode = unit::s);
     std::string format(unit mode = unit::s);
 };
 
+/**
+ * Repeated measurements of one quantity, summarized by percentile
+ */
+class Samples {
+    std::vector<double> values_;
+
+   public:
+    void add(double value);
+    std::size_t size() const;
+    double min() const;
+    double max() const;
+    double mean() const;
+    double percentile(double p) const;  // nearest rank, p in [0, 100]
+};
+
+/**
+ * Durations counted in power-of-two buckets of microseconds, so it stays the
+ * same size however many are added, for long-running processes
+ */
+class Histogram {
+   public:
+    static constexpr std::size_t buckets = 40;
+
+   private:
+    std::array<std::size_t, buckets> counts_ = {0};
+    std::size_t size_ = 0;
+
+   public:
+    void add(double seconds);
+    std::size_t size() const;
+    // bucket i holds durations below upper_bound(i), down to the previous
+    static double upper_bound(std::size_t bucket);
+    std::size_t count(std::size_t bucket) const;
+    // upper bound of the bucket holding the nearest rank, p in [0, 100]
+    double percentile(double p) const;
+};
+
+/**
+ * Hardware and software event counters for every thread of the current
+ * OpenMP team, backed by perf_event_open
+ *
+ * Events that cannot be opened (no PMU access, restrictive
+ * perf_event_paranoid, ...) read as NaN instead of failing.
+ */
+class Counters {
+   public:
+    enum event { cycles, instructions, branch_misses, llc_misses, page_faults };
+    static constexpr std::size_t events = 5;
+    static constexpr std::array<std::string_view, events> names = {
+        "cycles", "instructions", "branch_misses", "llc_misses",
+        "page_faults"};
+    using Values = std::array<double, events>;
+
+   private:
+    std::vector<std::array<int, events>> fds_;  // per thread
+
+   public:
+    Counters();
+    Counters(const Counters &) = delete;
+    Counters &operator=(const Counters &) = delete;
+    ~Counters();
+    bool available() const;  // at least one event opened
+    std::size_t threads() const;
+    std::vector<Values> read() const;  // per thread, since construction
+};
+
 #endif
@@ -2,36 +2,9 @@
 
 #include <cassert>
 #include <cstddef>
-#include <cstring>
 
 #include "print.hpp"
 
-void BitVector::copy(uint8_t *dest, std::size_t bit_offset) const {
-    // index of the next bit to write; also the number of bits written
-
-    uint16_t bits = bits_;
-    bits <<= 16 - size();  // left align
-
-    std::size_t bit_left = 8 - bit_offset;
-
-    uint8_t byte_value = 0;
-    std::memcpy(&byte_value, dest, 1);
-    byte_value = (byte_value | uint16_mask_first[bit_offset]) |
-                 static_cast<uint8_t>((bits & uint16_mask_first[bit_left]) >>
-                                      (16 - bit_left));
-    std::memcpy(dest, &byte_value, 1);
-
-    if (size() <= bit_left) return;
-    bits <<= bit_left;
-    byte_value = static_cast<uint8_t>((bits & uint16_mask_first[8]) >> 8);
-    std::memcpy(dest + 1, &byte_value, 1);
-
-    if (size() <= bit_left + 8) return;
-    bits <<= 8;
-    byte_value = static_cast<uint8_t>(bits >> 8);
-    std::memcpy(dest + 2, &byte_value, 1);
-}
-
 void BitVector::set(uint8_t bits) {
     bits_ = bits;
     size_ = 8;
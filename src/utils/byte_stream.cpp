@@ -12,14 +12,32 @@
 #include <cstring>
 #include <iostream>
 #include <string>
+#include <utility>
 
 #include "print.hpp"
 
+namespace {
+
+// from the page holding begin up to the one holding end, which may still be
+// in use by whatever comes after
+void release_pages(uint8_t *map, std::size_t begin, std::size_t end) {
+    static const std::size_t page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t first =
+        (reinterpret_cast<uintptr_t>(map) + begin) / page_size * page_size;
+    uintptr_t last =
+        (reinterpret_cast<uintptr_t>(map) + end) / page_size * page_size;
+    if (first < last) {
+        madvise(reinterpret_cast<void *>(first), last - first, MADV_DONTNEED);
+    }
+}
+
+}  // namespace
+
 /**
  * IByteStream
  */
 
-IByteStream::IByteStream(std::string pathname) {
+IByteStream::IByteStream(const std::string &pathname) {
     const char *pathname_c = pathname.c_str();
     int fd;
     if ((fd = open(pathname_c, O_RDONLY)) == -1) {
@@ -29,6 +47,12 @@ IByteStream::IByteStream(std::string pathname) {
     struct stat st;
     stat(pathname_c, &st);
     size_ = st.st_size;
+    // mmap takes no empty mapping, an empty file has nothing to map
+    if (size_ == 0) {
+        owner_ = false;
+        close(fd);
+        return;
+    }
     bs_ = static_cast<uint8_t *>(mmap(0, size_, PROT_READ, MAP_PRIVATE, fd, 0));
     if (bs_ == MAP_FAILED) {
         println("Error: {}", strerror(errno));
@@ -37,7 +61,44 @@ IByteStream::IByteStream(std::string pathname) {
     close(fd);
 }
 
-IByteStream::~IByteStream() { munmap(bs_, size_); }
+IByteStream::IByteStream(const uint8_t *data, std::size_t size)
+    : bs_(const_cast<uint8_t *>(data)),
+      size_(size),
+      mapped_(false),
+      owner_(false) {}
+
+IByteStream::IByteStream(const IByteStream &parent, std::size_t begin,
+                         std::size_t size)
+    : bs_(parent.bs_ + begin),
+      size_(size),
+      mapped_(parent.mapped_),
+      owner_(false) {}
+
+IByteStream::IByteStream(IByteStream &&other) noexcept
+    : bs_(std::exchange(other.bs_, nullptr)),
+      size_(std::exchange(other.size_, 0)),
+      mapped_(std::exchange(other.mapped_, false)),
+      owner_(std::exchange(other.owner_, false)) {}
+
+IByteStream &IByteStream::operator=(IByteStream &&other) noexcept {
+    if (this != &other) {
+        unmap();
+        bs_ = std::exchange(other.bs_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        mapped_ = std::exchange(other.mapped_, false);
+        owner_ = std::exchange(other.owner_, false);
+    }
+    return *this;
+}
+
+IByteStream::~IByteStream() { unmap(); }
+
+void IByteStream::unmap() {
+    if (owner_) {
+        munmap(bs_, size_);
+        owner_ = false;
+    }
+}
 
 std::size_t IByteStream::size() const { return size_; }
 
@@ -47,11 +108,18 @@ const uint8_t &IByteStream::operator[](std::size_t index) const {
 
 const uint8_t *IByteStream::map() const { return bs_; }
 
+void IByteStream::release(std::size_t begin, std::size_t end) const {
+    if (mapped_) {
+        release_pages(bs_, begin, end);
+    }
+}
+
 /**
  * OByteStream
  */
 
-OByteStream::OByteStream(std::string pathname, std::size_t size) : size_(size) {
+OByteStream::OByteStream(const std::string &pathname, std::size_t size)
+    : size_(size) {
     const char *pathname_c = pathname.c_str();
     if ((fd_ = open(pathname_c, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1) {
         println("Error: {}", strerror(errno));
@@ -61,6 +129,10 @@ OByteStream::OByteStream(std::string pathname, std::size_t size) : size_(size) {
         println("Error: {}", strerror(errno));
         exit(EXIT_FAILURE);
     }
+    if (size_ == 0) {
+        close(std::exchange(fd_, -1));
+        return;
+    }
     bs_ = static_cast<uint8_t *>(
         mmap(0, size_, PROT_WRITE, MAP_SHARED, fd_,
              0));  // assume that write allows happens on disjoint regions
@@ -70,11 +142,71 @@ OByteStream::OByteStream(std::string pathname, std::size_t size) : size_(size) {
     }
 }
 
-OByteStream::~OByteStream() {
-    munmap(bs_, size_);
-    close(fd_);
+OByteStream::OByteStream(const std::string &pathname, std::size_t size,
+                         std::size_t offset)
+    : size_(size) {
+    if ((fd_ = open(pathname.c_str(), O_RDWR)) == -1) {
+        println("Error: {}", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (ftruncate(fd_, offset + size_) == -1) {
+        println("Error: {}", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (size_ == 0) {
+        close(std::exchange(fd_, -1));
+        return;
+    }
+    static const std::size_t page_size = sysconf(_SC_PAGESIZE);
+    skip_ = offset % page_size;
+    bs_ = static_cast<uint8_t *>(mmap(0, skip_ + size_, PROT_READ | PROT_WRITE,
+                                      MAP_SHARED, fd_, offset - skip_));
+    if (bs_ == MAP_FAILED) {
+        println("Error: {}", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+OByteStream::OByteStream(std::vector<uint8_t> &buffer, std::size_t size,
+                         std::size_t offset)
+    : size_(size), fd_(-1) {
+    buffer.resize(offset + size);
+    bs_ = buffer.data() + offset;
+}
+
+OByteStream::OByteStream(OByteStream &&other) noexcept
+    : bs_(std::exchange(other.bs_, nullptr)),
+      size_(std::exchange(other.size_, 0)),
+      fd_(std::exchange(other.fd_, -1)),
+      skip_(std::exchange(other.skip_, 0)) {}
+
+OByteStream &OByteStream::operator=(OByteStream &&other) noexcept {
+    if (this != &other) {
+        unmap();
+        bs_ = std::exchange(other.bs_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        fd_ = std::exchange(other.fd_, -1);
+        skip_ = std::exchange(other.skip_, 0);
+    }
+    return *this;
+}
+
+OByteStream::~OByteStream() { unmap(); }
+
+void OByteStream::unmap() {
+    if (fd_ != -1) {
+        munmap(bs_, skip_ + size_);
+        close(fd_);
+        fd_ = -1;
+    }
 }
 
 std::size_t OByteStream::size() const { return size_; }
 
-uint8_t *OByteStream::map() { return bs_; }
+uint8_t *OByteStream::map() { return bs_ + skip_; }
+
+void OByteStream::release(std::size_t begin, std::size_t end) {
+    if (fd_ != -1) {
+        release_pages(bs_, skip_ + begin, skip_ + end);
+    }
+}
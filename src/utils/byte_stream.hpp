@@ -4,29 +4,66 @@
 #include <cstddef>
 #include <cstdint>
 #include <string>
+#include <vector>
 
 class IByteStream {
-    uint8_t *bs_;
+    uint8_t *bs_ = nullptr;
     std::size_t size_;
+    bool mapped_ = true;  // pages of a file, which release drops
+    bool owner_ = true;   // of the mapping, unmapped on destruction
+
+    void unmap();
 
    public:
-    IByteStream(std::string pathname);
+    IByteStream(const std::string &pathname);
+    // size bytes at data, which the caller keeps alive
+    IByteStream(const uint8_t *data, std::size_t size);
+    // size bytes of parent from begin on, which outlives the view
+    IByteStream(const IByteStream &parent, std::size_t begin,
+                std::size_t size);
+    // move-only, the moved-from stream owns nothing
+    IByteStream(const IByteStream &) = delete;
+    IByteStream &operator=(const IByteStream &) = delete;
+    IByteStream(IByteStream &&other) noexcept;
+    IByteStream &operator=(IByteStream &&other) noexcept;
     ~IByteStream();
     std::size_t size() const;
     const uint8_t &operator[](std::size_t index) const;
-    uint8_t *map() const;
+    const uint8_t *map() const;
+    // drops [begin, end) from memory, except the page holding end, so that
+    // ranges released in order never drop a page still in use. Pages are
+    // read back from the file if touched again. Does nothing in memory
+    void release(std::size_t begin, std::size_t end) const;
 };
 
 class OByteStream {
-    uint8_t *bs_;
+    uint8_t *bs_ = nullptr;
     std::size_t size_;
-    int fd_;
+    int fd_;  // -1 in memory
+    std::size_t skip_ = 0;  // from the first mapped page to the stream
+
+    void unmap();
 
    public:
-    OByteStream(std::string pathname, std::size_t size);
+    OByteStream(const std::string &pathname, std::size_t size);
+    // size bytes at offset of an existing file, which is resized to end
+    // there. The bytes before offset are kept
+    OByteStream(const std::string &pathname, std::size_t size,
+                std::size_t offset);
+    // size bytes of buffer from offset on, resized to end there. The bytes
+    // before offset are kept
+    OByteStream(std::vector<uint8_t> &buffer, std::size_t size,
+                std::size_t offset = 0);
+    // move-only, the moved-from stream owns nothing
+    OByteStream(const OByteStream &) = delete;
+    OByteStream &operator=(const OByteStream &) = delete;
+    OByteStream(OByteStream &&other) noexcept;
+    OByteStream &operator=(OByteStream &&other) noexcept;
     ~OByteStream();
     std::size_t size() const;
     uint8_t *map();
+    // same as IByteStream::release, written pages stay in the file
+    void release(std::size_t begin, std::size_t end);
 };
 
 #endif
@@ -0,0 +1,143 @@
+#include "hash.hpp"
+
+#include <cstring>
+
+namespace {
+
+constexpr uint64_t prime_1 = 0x9e3779b185ebca87;
+constexpr uint64_t prime_2 = 0xc2b2ae3d27d4eb4f;
+constexpr uint64_t prime_3 = 0x165667b19e3779f9;
+constexpr uint64_t prime_4 = 0x85ebca77c2b2ae63;
+constexpr uint64_t prime_5 = 0x27d4eb2f165667c5;
+
+uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+uint64_t read_64(const uint8_t *p) {
+    uint64_t value;
+    std::memcpy(&value, p, 8);
+    return value;
+}
+
+uint32_t read_32(const uint8_t *p) {
+    uint32_t value;
+    std::memcpy(&value, p, 4);
+    return value;
+}
+
+uint64_t lane_round(uint64_t acc, uint64_t input) {
+    acc += input * prime_2;
+    acc = rotl(acc, 31);
+    return acc * prime_1;
+}
+
+uint64_t merge_round(uint64_t acc, uint64_t value) {
+    acc ^= lane_round(0, value);
+    return acc * prime_1 + prime_4;
+}
+
+// folds the last bytes, fewer than 32, into hash and mixes it
+uint64_t finish(uint64_t hash, const uint8_t *p, const uint8_t *end) {
+    for (; p + 8 <= end; p += 8) {
+        hash ^= lane_round(0, read_64(p));
+        hash = rotl(hash, 27) * prime_1 + prime_4;
+    }
+    if (p + 4 <= end) {
+        hash ^= read_32(p) * prime_1;
+        hash = rotl(hash, 23) * prime_2 + prime_3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        hash ^= *p * prime_5;
+        hash = rotl(hash, 11) * prime_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime_2;
+    hash ^= hash >> 29;
+    hash *= prime_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+uint64_t merge_lanes(uint64_t v1, uint64_t v2, uint64_t v3, uint64_t v4) {
+    uint64_t hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    hash = merge_round(hash, v1);
+    hash = merge_round(hash, v2);
+    hash = merge_round(hash, v3);
+    return merge_round(hash, v4);
+}
+
+}  // namespace
+
+uint64_t xxhash64(const uint8_t *data, std::size_t size, uint64_t seed) {
+    const uint8_t *p = data;
+    const uint8_t *end = data + size;
+    uint64_t hash;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + prime_1 + prime_2;
+        uint64_t v2 = seed + prime_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - prime_1;
+        for (const uint8_t *limit = end - 32; p <= limit; p += 32) {
+            v1 = lane_round(v1, read_64(p));
+            v2 = lane_round(v2, read_64(p + 8));
+            v3 = lane_round(v3, read_64(p + 16));
+            v4 = lane_round(v4, read_64(p + 24));
+        }
+        hash = merge_lanes(v1, v2, v3, v4);
+    } else {
+        hash = seed + prime_5;
+    }
+    return finish(hash + size, p, end);
+}
+
+/**
+ * XxHash64
+ */
+
+XxHash64::XxHash64(uint64_t seed) : seed_(seed) { reset(); }
+
+void XxHash64::reset() {
+    lanes_ = {seed_ + prime_1 + prime_2, seed_ + prime_2, seed_,
+              seed_ - prime_1};
+    buffered_ = 0;
+    size_ = 0;
+}
+
+void XxHash64::update(const uint8_t *data, std::size_t size) {
+    const uint8_t *p = data;
+    const uint8_t *end = data + size;
+    size_ += size;
+    if (buffered_ + size < 32) {
+        std::memcpy(stripe_.data() + buffered_, p, size);
+        buffered_ += size;
+        return;
+    }
+    auto [v1, v2, v3, v4] = lanes_;
+    if (buffered_ != 0) {
+        std::size_t fill = 32 - buffered_;
+        std::memcpy(stripe_.data() + buffered_, p, fill);
+        p += fill;
+        v1 = lane_round(v1, read_64(stripe_.data()));
+        v2 = lane_round(v2, read_64(stripe_.data() + 8));
+        v3 = lane_round(v3, read_64(stripe_.data() + 16));
+        v4 = lane_round(v4, read_64(stripe_.data() + 24));
+    }
+    for (; end - p >= 32; p += 32) {
+        v1 = lane_round(v1, read_64(p));
+        v2 = lane_round(v2, read_64(p + 8));
+        v3 = lane_round(v3, read_64(p + 16));
+        v4 = lane_round(v4, read_64(p + 24));
+    }
+    lanes_ = {v1, v2, v3, v4};
+    buffered_ = end - p;
+    std::memcpy(stripe_.data(), p, buffered_);
+}
+
+uint64_t XxHash64::digest() const {
+    uint64_t hash = size_ >= 32 ? merge_lanes(lanes_[0], lanes_[1], lanes_[2],
+                                              lanes_[3])
+                                : seed_ + prime_5;
+    return finish(hash + size_, stripe_.data(), stripe_.data() + buffered_);
+}
@@ -0,0 +1,31 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * XXH64: four independent 64-bit lanes over 32-byte stripes, which the
+ * compiler keeps in registers and can vectorize
+ */
+uint64_t xxhash64(const uint8_t *data, std::size_t size, uint64_t seed = 0);
+
+/**
+ * XXH64 of data fed in pieces of any size, equal to xxhash64 of all of them
+ */
+class XxHash64 {
+    uint64_t seed_;
+    std::array<uint64_t, 4> lanes_;
+    std::array<uint8_t, 32> stripe_;  // bytes not yet in a lane
+    std::size_t buffered_;
+    std::size_t size_;
+
+   public:
+    explicit XxHash64(uint64_t seed = 0);
+    void reset();
+    void update(const uint8_t *data, std::size_t size);
+    uint64_t digest() const;
+};
+
+#endif
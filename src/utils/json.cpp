@@ -0,0 +1,129 @@
+#include "json.hpp"
+
+#include <cmath>
+#include <format>
+
+void Json::separate() {
+    if (after_key_) {
+        after_key_ = false;
+        return;
+    }
+    if (!first_.empty()) {
+        if (!first_.back()) {
+            out_ += ',';
+        }
+        first_.back() = false;
+    }
+}
+
+Json &Json::begin_object() {
+    separate();
+    out_ += '{';
+    first_.push_back(true);
+    return *this;
+}
+
+Json &Json::end_object() {
+    first_.pop_back();
+    out_ += '}';
+    return *this;
+}
+
+Json &Json::begin_array() {
+    separate();
+    out_ += '[';
+    first_.push_back(true);
+    return *this;
+}
+
+Json &Json::end_array() {
+    first_.pop_back();
+    out_ += ']';
+    return *this;
+}
+
+Json &Json::key(std::string_view key) {
+    value(key);
+    out_ += ':';
+    after_key_ = true;
+    return *this;
+}
+
+Json &Json::value(std::string_view value) {
+    separate();
+    out_ += '"';
+    for (char c : value) {
+        switch (c) {
+            case '"': {
+                out_ += "\\\"";
+                break;
+            }
+            case '\\': {
+                out_ += "\\\\";
+                break;
+            }
+            case '\n': {
+                out_ += "\\n";
+                break;
+            }
+            default: {
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out_ += std::format("\\u{:04x}", static_cast<int>(c));
+                } else {
+                    out_ += c;
+                }
+            }
+        }
+    }
+    out_ += '"';
+    return *this;
+}
+
+Json &Json::value(const char *value) {
+    return this->value(std::string_view(value));
+}
+
+Json &Json::value(double value) {
+    if (!std::isfinite(value)) {
+        return null();
+    }
+    separate();
+    out_ += std::format("{:.6g}", value);
+    return *this;
+}
+
+Json &Json::value(uint64_t value) {
+    separate();
+    out_ += std::to_string(value);
+    return *this;
+}
+
+Json &Json::value(int64_t value) {
+    separate();
+    out_ += std::to_string(value);
+    return *this;
+}
+
+Json &Json::value(int value) {
+    return this->value(static_cast<int64_t>(value));
+}
+
+Json &Json::value(bool value) {
+    separate();
+    out_ += value ? "true" : "false";
+    return *this;
+}
+
+Json &Json::null() {
+    separate();
+    out_ += "null";
+    return *this;
+}
+
+Json &Json::raw(std::string_view json) {
+    separate();
+    out_ += json;
+    return *this;
+}
+
+const std::string &Json::str() const { return out_; }
@@ -0,0 +1,38 @@
+#ifndef JSON_HPP
+#define JSON_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Minimal streaming JSON writer for machine-readable reports
+ */
+class Json {
+    std::string out_;
+    std::vector<bool> first_;  // one entry per open object/array
+    bool after_key_ = false;
+
+    void separate();
+
+   public:
+    Json &begin_object();
+    Json &end_object();
+    Json &begin_array();
+    Json &end_array();
+    Json &key(std::string_view key);
+    Json &value(std::string_view value);
+    Json &value(const char *value);
+    Json &value(double value);
+    Json &value(uint64_t value);
+    Json &value(int64_t value);
+    Json &value(int value);
+    Json &value(bool value);
+    Json &null();
+    Json &raw(std::string_view json);  // a value serialized elsewhere
+    const std::string &str() const;
+};
+
+#endif